@@ -0,0 +1,473 @@
+#include <getopt.h>
+#include <inttypes.h>
+#include <linux/input-event-codes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_pointer.h>
+#include <wlr/util/edges.h>
+#include <wlr/util/log.h>
+#include "client.h"
+#include "server.h"
+
+// pwc-bench runs pwc in-process on the headless backend with the pixman renderer, connects synthetic..
+// xdg-shell clients that are dispatched from the compositor's own event loop, and drives scripted scenarios.
+// Results are printed as JSON so runs of different versions can be compared.
+
+#define BENCH_MAP_TIMEOUT_NS 5000000000LL
+#define BENCH_SETTLE_NS 100000000LL
+
+struct bench;
+
+struct bench_scenario {
+    const char *name;
+    const char *description;
+    // Whether clients commit a new buffer on every frame callback
+    bool animate;
+    // Called once all windows are mapped, before measuring starts
+    void (*start)(struct bench *bench);
+    // Called every millisecond while measuring
+    void (*tick)(struct bench *bench);
+    void (*stop)(struct bench *bench);
+};
+
+struct bench_output {
+    struct wl_list link;
+    struct bench *bench;
+    struct wlr_output *wlr_output;
+    struct wl_listener frame;
+    struct wl_listener commit;
+    struct wl_listener destroy;
+    int64_t frame_start_ns;
+    int64_t last_commit_ns;
+};
+
+struct bench {
+    struct pwc_server server;
+    struct wl_event_loop *loop;
+    const char *socket;
+    struct wl_listener new_output;
+    struct wl_list outputs;
+
+    // Virtual input devices, fed straight into the backend's new_input signal like real hardware would be
+    struct wlr_pointer pointer;
+    struct wlr_keyboard keyboard;
+
+    struct bench_client **clients;
+    int num_clients;
+    int64_t duration_ns;
+    struct wl_event_source *tick_timer;
+    const struct bench_scenario *scenario;
+    uint64_t ticks;
+    uint64_t input_events;
+    bool measuring;
+
+    struct bench_samples frame_intervals;
+    struct bench_samples composite_times;
+    struct bench_samples latencies;
+};
+
+static const struct wlr_pointer_impl bench_pointer_impl = {
+    .name = "pwc-bench-pointer",
+};
+
+static const struct wlr_keyboard_impl bench_keyboard_impl = {
+    .name = "pwc-bench-keyboard",
+};
+
+static uint32_t bench_time_msec(void){
+    return get_time_ns() / 1000000;
+}
+
+static void bench_output_frame(struct wl_listener *listener, void *data){
+    // Runs before pwc's own frame handler, see bench_new_output()
+    struct bench_output *output = wl_container_of(listener, output, frame);
+    output->frame_start_ns = get_time_ns();
+}
+
+static void bench_output_commit(struct wl_listener *listener, void *data){
+    struct bench_output *output = wl_container_of(listener, output, commit);
+    struct bench *bench = output->bench;
+    const struct wlr_output_event_commit *event = data;
+    if (!(event->state->committed & WLR_OUTPUT_STATE_BUFFER)) return;
+
+    int64_t now = get_time_ns();
+    if (bench->measuring){
+        if (output->last_commit_ns != 0) bench_samples_add(&bench->frame_intervals, (now - output->last_commit_ns) / 1e6);
+        if (output->frame_start_ns != 0) bench_samples_add(&bench->composite_times, (now - output->frame_start_ns) / 1e6);
+    }
+    output->last_commit_ns = now;
+    output->frame_start_ns = 0;
+}
+
+static void bench_output_destroy(struct wl_listener *listener, void *data){
+    struct bench_output *output = wl_container_of(listener, output, destroy);
+    wl_list_remove(&output->frame.link);
+    wl_list_remove(&output->commit.link);
+    wl_list_remove(&output->destroy.link);
+    wl_list_remove(&output->link);
+    free(output);
+}
+
+static void bench_new_output(struct wl_listener *listener, void *data){
+    struct bench *bench = wl_container_of(listener, bench, new_output);
+    struct wlr_output *wlr_output = data;
+    struct bench_output *output = calloc(1, sizeof(*output));
+    if (output == NULL) return;
+    output->wlr_output = wlr_output;
+    output->bench = bench;
+
+    // The frame listener goes in front of pwc's so the composite time includes all of pwc's frame handling
+    output->frame.notify = bench_output_frame;
+    wl_list_insert(&wlr_output->events.frame.listener_list, &output->frame.link);
+    output->commit.notify = bench_output_commit;
+    wl_signal_add(&wlr_output->events.commit, &output->commit);
+    output->destroy.notify = bench_output_destroy;
+    wl_signal_add(&wlr_output->events.destroy, &output->destroy);
+    wl_list_insert(&bench->outputs, &output->link);
+}
+
+static void bench_run(struct bench *bench, int64_t duration_ns, bool (*done)(struct bench *bench)){
+    // Runs the compositor's event loop for a while, or until done() says so
+    int64_t end = get_time_ns() + duration_ns;
+    while (true){
+        if (done != NULL && done(bench)) return;
+        int64_t remaining = end - get_time_ns();
+        if (remaining <= 0) return;
+        wl_display_flush_clients(bench->server.wl_display);
+        wl_event_loop_dispatch(bench->loop, remaining > 10000000 ? 10 : remaining / 1000000 + 1);
+    }
+}
+
+static bool bench_clients_mapped(struct bench *bench){
+    for (int i = 0; i < bench->num_clients; i++){
+        if (bench->clients[i]->failed) return true;
+        if (!bench->clients[i]->mapped) return false;
+    }
+    return true;
+}
+
+static int bench_handle_tick(void *data){
+    struct bench *bench = data;
+    bench->ticks++;
+    if (bench->scenario->tick != NULL) bench->scenario->tick(bench);
+    wl_event_source_timer_update(bench->tick_timer, 1);
+    return 0;
+}
+
+static void bench_pointer_motion(struct bench *bench, double dx, double dy){
+    struct wlr_pointer_motion_event event = {
+        .pointer = &bench->pointer,
+        .time_msec = bench_time_msec(),
+        .delta_x = dx,
+        .delta_y = dy,
+        .unaccel_dx = dx,
+        .unaccel_dy = dy,
+    };
+    wl_signal_emit_mutable(&bench->pointer.events.motion, &event);
+    wl_signal_emit_mutable(&bench->pointer.events.frame, &bench->pointer);
+    bench->input_events++;
+}
+
+static void bench_pointer_release(struct bench *bench){
+    // Any button release ends pwc's interactive move/resize
+    struct wlr_pointer_button_event event = {
+        .pointer = &bench->pointer,
+        .time_msec = bench_time_msec(),
+        .button = BTN_LEFT,
+        .state = WL_POINTER_BUTTON_STATE_RELEASED,
+    };
+    wl_signal_emit_mutable(&bench->pointer.events.button, &event);
+    wl_signal_emit_mutable(&bench->pointer.events.frame, &bench->pointer);
+}
+
+static void bench_key(struct bench *bench, uint32_t keycode, bool pressed){
+    struct wlr_keyboard_key_event event = {
+        .time_msec = bench_time_msec(),
+        .keycode = keycode,
+        .update_state = true,
+        .state = pressed ? WL_KEYBOARD_KEY_STATE_PRESSED : WL_KEYBOARD_KEY_STATE_RELEASED,
+    };
+    wlr_keyboard_notify_key(&bench->keyboard, &event);
+    bench->input_events++;
+}
+
+static struct bench_client *bench_top_client(struct bench *bench){
+    // The last window to map is the focused one on top
+    return bench->num_clients > 0 ? bench->clients[bench->num_clients - 1] : NULL;
+}
+
+static void scenario_grab_start(struct bench *bench, bool resize){
+    // Put the cursor inside the top window and start an interactive grab on it
+    struct bench_client *client = bench_top_client(bench);
+    if (client == NULL) return;
+    wlr_cursor_warp(bench->server.cursor, NULL, 100, 100);
+    if (resize) bench_client_resize(client, WLR_EDGE_BOTTOM | WLR_EDGE_RIGHT);
+    else bench_client_move(client);
+    bench_run(bench, BENCH_SETTLE_NS, NULL);
+}
+
+static void scenario_move_start(struct bench *bench){
+    scenario_grab_start(bench, false);
+}
+
+static void scenario_resize_start(struct bench *bench){
+    scenario_grab_start(bench, true);
+}
+
+static void scenario_grab_tick(struct bench *bench){
+    // 1000 Hz pointer, sweeping 200 px right then back left
+    double dx = (bench->ticks / 200) % 2 == 0 ? 1 : -1;
+    bench_pointer_motion(bench, dx, dx / 2);
+}
+
+static void scenario_grab_stop(struct bench *bench){
+    bench_pointer_release(bench);
+}
+
+static void scenario_focus_start(struct bench *bench){
+    bench_key(bench, KEY_LEFTALT, true);
+}
+
+static void scenario_focus_tick(struct bench *bench){
+    // Alt+F1 cycles to the next window, 100 times a second
+    if (bench->ticks % 10 != 0) return;
+    bench_key(bench, KEY_F1, true);
+    bench_key(bench, KEY_F1, false);
+}
+
+static void scenario_focus_stop(struct bench *bench){
+    bench_key(bench, KEY_LEFTALT, false);
+}
+
+static const struct bench_scenario scenarios[] = {
+    { .name = "idle", .description = "mapped windows that never redraw" },
+    { .name = "commits", .description = "every window commits a new buffer on each frame callback", .animate = true },
+    { .name = "move", .description = "interactive move of the top window with a 1000 Hz pointer",
+        .start = scenario_move_start, .tick = scenario_grab_tick, .stop = scenario_grab_stop },
+    { .name = "resize", .description = "interactive resize of the top window with a 1000 Hz pointer",
+        .start = scenario_resize_start, .tick = scenario_grab_tick, .stop = scenario_grab_stop },
+    { .name = "focus", .description = "cycling focus through all windows with Alt+F1 at 100 Hz",
+        .start = scenario_focus_start, .tick = scenario_focus_tick, .stop = scenario_focus_stop },
+};
+
+static int64_t cpu_time_ns(void){
+    // User and system time of the whole process, compositor and synthetic clients alike
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return ((int64_t)usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000 +
+        ((int64_t)usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000;
+}
+
+static void print_samples(FILE *out, const char *name, struct bench_samples *samples){
+    fprintf(out, "      \"%s\": {\"count\": %zu, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n", name, samples->len,
+            bench_samples_percentile(samples, 50), bench_samples_percentile(samples, 90),
+            bench_samples_percentile(samples, 99), bench_samples_percentile(samples, 100));
+}
+
+static void run_scenario(struct bench *bench, const struct bench_scenario *scenario, int num_clients, FILE *out, bool first){
+    bench->scenario = scenario;
+    bench->ticks = 0;
+    bool failed = false;
+
+    bench->clients = calloc(num_clients, sizeof(*bench->clients));
+    bench->num_clients = 0;
+    if (bench->clients == NULL) failed = true;
+    for (int i = 0; i < num_clients && !failed; i++){
+        struct bench_client *client = bench_client_create(bench->loop, bench->socket, i, scenario->animate);
+        if (client == NULL){
+            failed = true;
+            break;
+        }
+        bench->clients[bench->num_clients++] = client;
+        // Map one at a time so stacking order matches creation order
+        bench_run(bench, BENCH_MAP_TIMEOUT_NS, bench_clients_mapped);
+    }
+    for (int i = 0; i < bench->num_clients; i++){
+        if (!bench->clients[i]->mapped || bench->clients[i]->failed) failed = true;
+    }
+
+    uint64_t committed = 0, skipped = 0, configures = 0;
+    uint64_t coalesced = bench->server.motion_coalesced;
+    struct pwc_output *output;
+    wl_list_for_each(output, &bench->server.outputs, link){
+        committed -= output->frames_committed;
+        skipped -= output->frames_skipped;
+    }
+    for (int i = 0; i < bench->num_clients; i++){
+        bench->clients[i]->latency = &bench->latencies;
+        configures -= bench->clients[i]->configures;
+    }
+
+    if (!failed && scenario->start != NULL) scenario->start(bench);
+    bench->input_events = 0;
+    int64_t cpu_start = cpu_time_ns();
+    bench->measuring = true;
+    if (!failed) wl_event_source_timer_update(bench->tick_timer, 1);
+    if (!failed) bench_run(bench, bench->duration_ns, NULL);
+    wl_event_source_timer_update(bench->tick_timer, 0);
+    bench->measuring = false;
+    int64_t cpu = cpu_time_ns() - cpu_start;
+    if (!failed && scenario->stop != NULL) scenario->stop(bench);
+
+    wl_list_for_each(output, &bench->server.outputs, link){
+        committed += output->frames_committed;
+        skipped += output->frames_skipped;
+    }
+    for (int i = 0; i < bench->num_clients; i++) configures += bench->clients[i]->configures;
+    coalesced = bench->server.motion_coalesced - coalesced;
+
+    fprintf(out, "%s    {\n", first ? "" : ",\n");
+    fprintf(out, "      \"name\": \"%s\",\n", scenario->name);
+    fprintf(out, "      \"description\": \"%s\",\n", scenario->description);
+    fprintf(out, "      \"windows\": %d,\n", bench->num_clients);
+    fprintf(out, "      \"duration_s\": %.3f,\n", bench->duration_ns / 1e9);
+    fprintf(out, "      \"input_events\": %" PRIu64 ",\n", bench->input_events);
+    fprintf(out, "      \"motion_coalesced\": %" PRIu64 ",\n", coalesced);
+    fprintf(out, "      \"frames_committed\": %" PRIu64 ",\n", committed);
+    fprintf(out, "      \"frames_skipped\": %" PRIu64 ",\n", skipped);
+    fprintf(out, "      \"configures\": %" PRIu64 ",\n", configures);
+    print_samples(out, "frame_interval_ms", &bench->frame_intervals);
+    print_samples(out, "composite_ms", &bench->composite_times);
+    // Measured up to wl_callback.done, which pwc sends when the frame is committed (timestamped with the predicted..
+    // vblank), not up to the actual present
+    print_samples(out, "commit_to_frame_done_ms", &bench->latencies);
+    fprintf(out, "      \"cpu_ms\": %.3f,\n", cpu / 1e6);
+    fprintf(out, "      \"cpu_per_frame_ms\": %.3f,\n", committed > 0 ? cpu / 1e6 / committed : 0.0);
+    fprintf(out, "      \"ok\": %s\n", failed ? "false" : "true");
+    fprintf(out, "    }");
+
+    // Tear the windows down and let the compositor process the disconnects before the next scenario
+    for (int i = 0; i < bench->num_clients; i++) bench_client_destroy(bench->clients[i]);
+    free(bench->clients);
+    bench->clients = NULL;
+    bench_run(bench, BENCH_SETTLE_NS, NULL);
+    bench_samples_clear(&bench->frame_intervals);
+    bench_samples_clear(&bench->composite_times);
+    bench_samples_clear(&bench->latencies);
+}
+
+static void usage(const char *name){
+    printf("Usage: %s [-n windows] [-t seconds] [-s scenario] [-o output.json] [-m WxH@HZ] [-d] [-c]\n", name);
+    printf("Scenarios:");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) printf(" %s", scenarios[i].name);
+    printf("\n");
+}
+
+int main(int argc, char *argv[]){
+    struct bench bench = {0};
+    wl_list_init(&bench.server.output_configs);
+    int num_clients = 16;
+    double seconds = 5;
+    const char *only = NULL;
+    const char *out_path = NULL;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:t:s:o:m:dch")) != -1){
+        switch (c){
+            case 'n':
+                num_clients = atoi(optarg);
+                break;
+            case 't':
+                seconds = atof(optarg);
+                break;
+            case 's':
+                only = optarg;
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            case 'm':{
+                // Custom mode for the headless output, e.g. 2560x1440@240
+                char spec[128];
+                snprintf(spec, sizeof(spec), "HEADLESS-1:mode=%s", optarg);
+                if (!output_config_parse(&bench.server, spec)){
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            }
+            case 'd':
+                bench.server.render_late = true;
+                break;
+            case 'c':
+                bench.server.coalesce_motion = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 0;
+        }
+    }
+    if (optind < argc || num_clients < 1 || seconds <= 0){
+        usage(argv[0]);
+        return 1;
+    }
+    if (only != NULL){
+        size_t i = 0;
+        while (i < sizeof(scenarios) / sizeof(scenarios[0]) && strcmp(only, scenarios[i].name) != 0) i++;
+        if (i == sizeof(scenarios) / sizeof(scenarios[0])){
+            fprintf(stderr, "pwc-bench: unknown scenario '%s'\n", only);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    FILE *out = stdout;
+    if (out_path != NULL && (out = fopen(out_path, "w")) == NULL){
+        perror(out_path);
+        return 1;
+    }
+
+    // Reproducible setup: one headless output rendered with pixman, no real input devices
+    wlr_log_init(WLR_ERROR, NULL);
+    setenv("WLR_BACKENDS", "headless", true);
+    setenv("WLR_RENDERER", "pixman", true);
+    setenv("WLR_HEADLESS_OUTPUTS", "1", true);
+    unsetenv("WAYLAND_DISPLAY");
+
+    if (!server_init(&bench.server)) return 1;
+    bench.loop = wl_display_get_event_loop(bench.server.wl_display);
+    wl_list_init(&bench.outputs);
+    bench.new_output.notify = bench_new_output;
+    wl_signal_add(&bench.server.backend->events.new_output, &bench.new_output);
+
+    bench.socket = wl_display_add_socket_auto(bench.server.wl_display);
+    if (bench.socket == NULL || !wlr_backend_start(bench.server.backend)){
+        fprintf(stderr, "pwc-bench: failed to start the compositor\n");
+        return 1;
+    }
+
+    wlr_pointer_init(&bench.pointer, &bench_pointer_impl, bench_pointer_impl.name);
+    wl_signal_emit_mutable(&bench.server.backend->events.new_input, &bench.pointer.base);
+    wlr_keyboard_init(&bench.keyboard, &bench_keyboard_impl, bench_keyboard_impl.name);
+    wl_signal_emit_mutable(&bench.server.backend->events.new_input, &bench.keyboard.base);
+    bench.tick_timer = wl_event_loop_add_timer(bench.loop, bench_handle_tick, &bench);
+    bench.duration_ns = seconds * 1e9;
+
+    fprintf(out, "{\n  \"pwc_version\": \"%s\",\n  \"backend\": \"headless\",\n  \"renderer\": \"pixman\",\n", PWC_VERSION);
+    fprintf(out, "  \"render_late\": %s,\n", bench.server.render_late ? "true" : "false");
+    fprintf(out, "  \"coalesce_motion\": %s,\n  \"scenarios\": [\n", bench.server.coalesce_motion ? "true" : "false");
+    bool first = true;
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++){
+        if (only != NULL && strcmp(only, scenarios[i].name) != 0) continue;
+        run_scenario(&bench, &scenarios[i], num_clients, out, first);
+        first = false;
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) fclose(out);
+
+    wl_event_source_remove(bench.tick_timer);
+    wlr_keyboard_finish(&bench.keyboard);
+    wlr_pointer_finish(&bench.pointer);
+    wl_list_remove(&bench.new_output.link);
+    server_finish(&bench.server);
+    return 0;
+}
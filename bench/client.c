@@ -0,0 +1,315 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-client-core.h>
+#include <wayland-client-protocol.h>
+#include <wayland-server-core.h>
+#include "client.h"
+#include "xdg-shell-client-protocol.h"
+
+// Size picked by the client when the compositor leaves it up to us
+#define BENCH_CLIENT_WIDTH 320
+#define BENCH_CLIENT_HEIGHT 240
+
+static int64_t client_time_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void bench_samples_add(struct bench_samples *samples, double value){
+    if (samples->len == samples->cap){
+        size_t cap = samples->cap ? samples->cap * 2 : 1024;
+        double *values = realloc(samples->values, cap * sizeof(*values));
+        if (values == NULL) return;
+        samples->values = values;
+        samples->cap = cap;
+    }
+    samples->values[samples->len++] = value;
+}
+
+static int compare_doubles(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+double bench_samples_percentile(struct bench_samples *samples, double percentile){
+    // Nearest rank percentile, 0 when there are no samples
+    if (samples->len == 0) return 0;
+    qsort(samples->values, samples->len, sizeof(double), compare_doubles);
+    size_t rank = (size_t)(percentile / 100.0 * (samples->len - 1) + 0.5);
+    return samples->values[rank];
+}
+
+void bench_samples_clear(struct bench_samples *samples){
+    free(samples->values);
+    samples->values = NULL;
+    samples->len = samples->cap = 0;
+}
+
+static void buffer_handle_release(void *data, struct wl_buffer *wl_buffer){
+    struct bench_buffer *buffer = data;
+    buffer->busy = false;
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_handle_release,
+};
+
+static void buffer_finish(struct bench_buffer *buffer){
+    if (buffer->wl_buffer == NULL) return;
+    wl_buffer_destroy(buffer->wl_buffer);
+    munmap(buffer->data, buffer->size);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+static bool buffer_init(struct bench_client *client, struct bench_buffer *buffer, int width, int height){
+    // Allocates an XRGB8888 shm buffer. The shm object is unlinked right away, only the fd is kept around
+    int stride = width * 4;
+    size_t size = (size_t)stride * height;
+    char name[64];
+    snprintf(name, sizeof(name), "/pwc-bench-%d-%p", getpid(), (void *)buffer);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) return false;
+    shm_unlink(name);
+    if (ftruncate(fd, size) < 0){
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED){
+        close(fd);
+        return false;
+    }
+
+    struct wl_shm_pool *pool = wl_shm_create_pool(client->shm, fd, size);
+    buffer->wl_buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
+    wl_shm_pool_destroy(pool);
+    close(fd);
+
+    wl_buffer_add_listener(buffer->wl_buffer, &buffer_listener, buffer);
+    buffer->data = data;
+    buffer->size = size;
+    buffer->width = width;
+    buffer->height = height;
+    return true;
+}
+
+static struct bench_buffer *client_next_buffer(struct bench_client *client){
+    // Picks a free buffer of the current size, reallocating ones of the wrong size
+    for (int i = 0; i < 2; i++){
+        struct bench_buffer *buffer = &client->buffers[i];
+        if (buffer->busy) continue;
+        if (buffer->wl_buffer != NULL && (buffer->width != client->width || buffer->height != client->height)) buffer_finish(buffer);
+        if (buffer->wl_buffer == NULL && !buffer_init(client, buffer, client->width, client->height)) return NULL;
+        return buffer;
+    }
+    return NULL;
+}
+
+static void client_draw(struct bench_client *client);
+
+static void frame_handle_done(void *data, struct wl_callback *callback, uint32_t time){
+    // The frame containing our last commit has been composited
+    struct bench_client *client = data;
+    wl_callback_destroy(callback);
+    client->frame_callback = NULL;
+    client->mapped = true;
+    if (client->latency != NULL && client->commit_ns != 0){
+        bench_samples_add(client->latency, (client_time_ns() - client->commit_ns) / 1e6);
+    }
+    client->commit_ns = 0;
+    if (client->animate) client_draw(client);
+}
+
+static const struct wl_callback_listener frame_listener = {
+    .done = frame_handle_done,
+};
+
+static void client_draw(struct bench_client *client){
+    // Fills a new buffer with a colour that changes every frame and commits it with full damage
+    struct bench_buffer *buffer = client_next_buffer(client);
+    if (buffer == NULL){
+        // Both buffers are still held by the compositor. Skip this frame but keep the frame callbacks coming
+        if (client->frame_callback == NULL){
+            client->frame_callback = wl_surface_frame(client->surface);
+            wl_callback_add_listener(client->frame_callback, &frame_listener, client);
+        }
+        wl_surface_commit(client->surface);
+        return;
+    }
+
+    uint32_t colour = 0xff000000 | (client->frame * 0x010305);
+    uint32_t *pixels = buffer->data;
+    for (size_t i = 0; i < buffer->size / 4; i++) pixels[i] = colour;
+    client->frame++;
+
+    wl_surface_attach(client->surface, buffer->wl_buffer, 0, 0);
+    wl_surface_damage_buffer(client->surface, 0, 0, buffer->width, buffer->height);
+    if (client->frame_callback == NULL){
+        client->frame_callback = wl_surface_frame(client->surface);
+        wl_callback_add_listener(client->frame_callback, &frame_listener, client);
+    }
+    buffer->busy = true;
+    client->commit_ns = client_time_ns();
+    wl_surface_commit(client->surface);
+}
+
+static void xdg_surface_handle_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial){
+    // Always answer with a buffer of the configured size, like a well behaved client would
+    struct bench_client *client = data;
+    xdg_surface_ack_configure(xdg_surface, serial);
+    client->configures++;
+    client->width = client->configure_width > 0 ? client->configure_width : BENCH_CLIENT_WIDTH;
+    client->height = client->configure_height > 0 ? client->configure_height : BENCH_CLIENT_HEIGHT;
+    client_draw(client);
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+    .configure = xdg_surface_handle_configure,
+};
+
+static void xdg_toplevel_handle_configure(void *data, struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height, struct wl_array *states){
+    struct bench_client *client = data;
+    client->configure_width = width;
+    client->configure_height = height;
+}
+
+static void xdg_toplevel_handle_close(void *data, struct xdg_toplevel *xdg_toplevel){
+    // Nothing to do, the bench decides when windows go away
+}
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+    .configure = xdg_toplevel_handle_configure,
+    .close = xdg_toplevel_handle_close,
+};
+
+static void wm_base_handle_ping(void *data, struct xdg_wm_base *wm_base, uint32_t serial){
+    xdg_wm_base_pong(wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+    .ping = wm_base_handle_ping,
+};
+
+static void registry_handle_global(void *data, struct wl_registry *registry, uint32_t name, const char *interface, uint32_t version){
+    struct bench_client *client = data;
+    if (strcmp(interface, wl_compositor_interface.name) == 0){
+        client->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 4);
+    }
+    else if (strcmp(interface, wl_shm_interface.name) == 0){
+        client->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+    }
+    else if (strcmp(interface, wl_seat_interface.name) == 0 && client->seat == NULL){
+        client->seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
+    }
+    else if (strcmp(interface, xdg_wm_base_interface.name) == 0){
+        client->wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
+        xdg_wm_base_add_listener(client->wm_base, &wm_base_listener, client);
+    }
+}
+
+static void registry_handle_global_remove(void *data, struct wl_registry *registry, uint32_t name){
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_handle_global,
+    .global_remove = registry_handle_global_remove,
+};
+
+static void sync_handle_done(void *data, struct wl_callback *callback, uint32_t serial){
+    // All globals have been announced, create the window. The first commit has no buffer so that the..
+    // compositor answers with a configure
+    struct bench_client *client = data;
+    wl_callback_destroy(callback);
+    client->sync_callback = NULL;
+    if (client->compositor == NULL || client->shm == NULL || client->wm_base == NULL){
+        fprintf(stderr, "pwc-bench: compositor is missing required globals\n");
+        client->failed = true;
+        return;
+    }
+
+    client->surface = wl_compositor_create_surface(client->compositor);
+    client->xdg_surface = xdg_wm_base_get_xdg_surface(client->wm_base, client->surface);
+    xdg_surface_add_listener(client->xdg_surface, &xdg_surface_listener, client);
+    client->xdg_toplevel = xdg_surface_get_toplevel(client->xdg_surface);
+    xdg_toplevel_add_listener(client->xdg_toplevel, &xdg_toplevel_listener, client);
+    xdg_toplevel_set_title(client->xdg_toplevel, "pwc-bench");
+    xdg_toplevel_set_app_id(client->xdg_toplevel, "pwc-bench");
+    wl_surface_commit(client->surface);
+}
+
+static const struct wl_callback_listener sync_listener = {
+    .done = sync_handle_done,
+};
+
+static int client_handle_readable(int fd, uint32_t mask, void *data){
+    // Called from the server's event loop when the compositor has sent us something
+    struct bench_client *client = data;
+    if ((mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) || wl_display_dispatch(client->display) < 0){
+        if (!client->failed) fprintf(stderr, "pwc-bench: client lost its connection: %s\n", strerror(errno));
+        client->failed = true;
+        wl_event_source_remove(client->source);
+        client->source = NULL;
+        return 0;
+    }
+    wl_display_flush(client->display);
+    return 0;
+}
+
+struct bench_client *bench_client_create(struct wl_event_loop *loop, const char *socket, int index, bool animate){
+    struct bench_client *client = calloc(1, sizeof(*client));
+    if (client == NULL) return NULL;
+    client->animate = animate;
+    client->display = wl_display_connect(socket);
+    if (client->display == NULL){
+        fprintf(stderr, "pwc-bench: failed to connect client %d to %s\n", index, socket);
+        free(client);
+        return NULL;
+    }
+
+    client->registry = wl_display_get_registry(client->display);
+    wl_registry_add_listener(client->registry, &registry_listener, client);
+    client->sync_callback = wl_display_sync(client->display);
+    wl_callback_add_listener(client->sync_callback, &sync_listener, client);
+    wl_display_flush(client->display);
+
+    client->source = wl_event_loop_add_fd(loop, wl_display_get_fd(client->display), WL_EVENT_READABLE, client_handle_readable, client);
+    return client;
+}
+
+void bench_client_destroy(struct bench_client *client){
+    if (client->source != NULL) wl_event_source_remove(client->source);
+    if (client->frame_callback != NULL) wl_callback_destroy(client->frame_callback);
+    if (client->sync_callback != NULL) wl_callback_destroy(client->sync_callback);
+    for (int i = 0; i < 2; i++) buffer_finish(&client->buffers[i]);
+    if (client->xdg_toplevel != NULL) xdg_toplevel_destroy(client->xdg_toplevel);
+    if (client->xdg_surface != NULL) xdg_surface_destroy(client->xdg_surface);
+    if (client->surface != NULL) wl_surface_destroy(client->surface);
+    if (client->wm_base != NULL) xdg_wm_base_destroy(client->wm_base);
+    if (client->seat != NULL) wl_seat_destroy(client->seat);
+    if (client->shm != NULL) wl_shm_destroy(client->shm);
+    if (client->compositor != NULL) wl_compositor_destroy(client->compositor);
+    wl_registry_destroy(client->registry);
+    wl_display_flush(client->display);
+    wl_display_disconnect(client->display);
+    free(client);
+}
+
+void bench_client_move(struct bench_client *client){
+    // pwc doesn't validate grab serials, so the request can come without a button press
+    if (client->seat == NULL || client->xdg_toplevel == NULL) return;
+    xdg_toplevel_move(client->xdg_toplevel, client->seat, 0);
+    wl_display_flush(client->display);
+}
+
+void bench_client_resize(struct bench_client *client, uint32_t edges){
+    if (client->seat == NULL || client->xdg_toplevel == NULL) return;
+    xdg_toplevel_resize(client->xdg_toplevel, client->seat, 0, edges);
+    wl_display_flush(client->display);
+}
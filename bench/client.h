@@ -0,0 +1,65 @@
+#ifndef PWC_BENCH_CLIENT_H
+#define PWC_BENCH_CLIENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-client-core.h>
+#include <wayland-server-core.h>
+
+// A growable list of samples, in milliseconds
+struct bench_samples {
+    double *values;
+    size_t len, cap;
+};
+
+struct bench_buffer {
+    struct wl_buffer *wl_buffer;
+    void *data;
+    size_t size;
+    int width, height;
+    bool busy;
+};
+
+// Synthetic xdg-shell client. It runs on the server's own event loop: its display fd is dispatched from there..
+// so the client must never block, i.e. no roundtrips.
+struct bench_client {
+    struct wl_display *display;
+    struct wl_event_source *source;
+    struct wl_registry *registry;
+    struct wl_compositor *compositor;
+    struct wl_shm *shm;
+    struct wl_seat *seat;
+    struct xdg_wm_base *wm_base;
+    struct wl_callback *sync_callback;
+
+    struct wl_surface *surface;
+    struct xdg_surface *xdg_surface;
+    struct xdg_toplevel *xdg_toplevel;
+    struct wl_callback *frame_callback;
+    struct bench_buffer buffers[2];
+
+    // Size from the last toplevel configure, 0 lets the client pick
+    int configure_width, configure_height;
+    int width, height;
+    bool mapped;
+    bool failed;
+
+    // Commit a new buffer on every frame callback instead of only when configured
+    bool animate;
+    uint32_t frame;
+    int64_t commit_ns;
+    uint64_t configures;
+    struct bench_samples *latency;
+};
+
+struct bench_client *bench_client_create(struct wl_event_loop *loop, const char *socket, int index, bool animate);
+void bench_client_destroy(struct bench_client *client);
+void bench_client_move(struct bench_client *client);
+void bench_client_resize(struct bench_client *client, uint32_t edges);
+
+void bench_samples_add(struct bench_samples *samples, double value);
+double bench_samples_percentile(struct bench_samples *samples, double percentile);
+void bench_samples_clear(struct bench_samples *samples);
+
+#endif
@@ -0,0 +1,626 @@
+#ifndef PWC_SERVER_H
+#define PWC_SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <wayland-server-core.h>
+#include <wlr/util/box.h>
+#include <wlr/util/log.h>
+
+struct wlr_input_device;
+struct wlr_output;
+struct wlr_output_state;
+struct wlr_surface;
+struct wlr_xwayland_surface;
+struct xkb_rule_names;
+
+enum pwc_vrr {
+    PWC_VRR_AUTO, // Adaptive sync while a fullscreen window is focused
+    PWC_VRR_OFF,
+    PWC_VRR_ON,
+};
+
+enum pwc_cursor_mode {
+    PWC_CURSOR_PASSTHROUGH,
+    PWC_CURSOR_MOVE,
+    PWC_CURSOR_RESIZE,
+};
+
+// Number of composite times kept per output to predict the next one
+#define PWC_RENDER_SAMPLES 16
+// Bounds for the extra time left between finishing a composite and the vblank
+#define PWC_RENDER_MARGIN_MIN_NS 1000000
+#define PWC_RENDER_MARGIN_START_NS 2000000
+
+// Present interval histogram buckets, in vblanks: 1, 2, 3, 4 and 5 or more
+#define PWC_PRESENT_BUCKETS 5
+
+// Hidden surfaces still get a frame callback this often, see occlusion.c
+#define PWC_OCCLUDED_FRAME_MS 1000
+
+// Workspaces, switched with Alt+1 to Alt+9
+#define PWC_WORKSPACES 9
+
+// How long a layout transaction waits for clients to commit at their new size
+#define PWC_TRANSACTION_TIMEOUT_MS 200
+
+// Xwayland exits after this many seconds without X11 clients, and starts again on the next connection
+#define PWC_XWAYLAND_IDLE_S 30
+
+// Startup phases kept for the profile (-p), and how long deferred setup waits for a first frame before running..
+// anyway, see startup.c
+#define PWC_STARTUP_PHASES 16
+#define PWC_STARTUP_DEFER_MS 2000
+
+// Run by Alt+Return unless -t says otherwise
+#define PWC_DEFAULT_TERMINAL "alacritty"
+
+// Asynchronous log ring (-l). Messages longer than a slot are truncated
+#define PWC_LOG_SLOTS 4096
+#define PWC_LOG_LINE_MAX 512
+
+// Tracing (-T, SIGUSR2). Each track is a row in the trace viewer
+enum pwc_trace_track {
+    PWC_TRACE_INPUT = 1,
+    PWC_TRACE_CLIENTS,
+    PWC_TRACE_OUTPUTS,
+};
+// Events kept per recording, later ones are dropped
+#define PWC_TRACE_MAX_EVENTS (1 << 20)
+#define PWC_TRACE_DETAIL_MAX 32
+
+// Hit-test grid. Cells are square in layout coordinates and hashed into a fixed number of buckets
+#define PWC_HIT_CELL_SIZE 256
+#define PWC_HIT_BUCKETS 256
+
+struct pwc_hit_index {
+    struct wl_list buckets[PWC_HIT_BUCKETS]; // struct pwc_hit_cell::link
+    // Bumped whenever a toplevel moves, resizes or is restacked. The cached hit is only reused while it matches
+    uint64_t generation;
+    uint64_t stack_counter;
+    struct {
+        uint64_t generation;
+        struct pwc_toplevel *toplevel;
+        struct wlr_surface *surface;
+        struct wlr_box box;
+        int origin_x, origin_y;
+        struct wl_listener surface_destroy;
+    } cache;
+
+    uint64_t hit_tests;
+    uint64_t cache_hits;
+    int64_t time_ns;
+};
+
+struct pwc_output_config {
+    // Settings given with -o for the output called name. width is 0 when no mode was given, scale 0 for the default
+    struct wl_list link;
+    char *name;
+    int width, height, refresh_mhz;
+    double scale;
+    bool has_position;
+    int x, y;
+    enum pwc_vrr vrr;
+};
+
+struct pwc_workspace {
+    struct pwc_server *server;
+    int index;
+    // Disabled unless this is the active workspace. Holds toplevel_tree, and fullscreen_tree stacked above it
+    struct wlr_scene_tree *tree;
+    struct wlr_scene_tree *toplevel_tree;
+    struct wlr_scene_tree *fullscreen_tree;
+    // Windows are tiled by layout.c instead of placed by hand
+    bool tiling;
+};
+
+struct pwc_startup_phase {
+    const char *name;
+    int64_t duration_ns;
+};
+
+struct pwc_server {
+    struct wl_display *wl_display;
+    struct wlr_backend *backend;
+    struct wlr_renderer *renderer;
+    struct wlr_allocator *allocator;
+    struct wlr_compositor *compositor;
+    // NULL when the renderer can't import dmabufs
+    struct wlr_linux_dmabuf_v1 *linux_dmabuf;
+    struct wlr_scene *scene;
+    struct wlr_scene_output_layout *scene_layout;
+    // Toplevels live in the tree of their workspace, see workspace.c
+    struct pwc_workspace workspaces[PWC_WORKSPACES];
+    struct pwc_workspace *active_workspace;
+    struct wl_global *workspace_global;
+    struct wl_list workspace_managers;
+
+    // Tiling layout transaction. transaction_waiting counts the windows that haven't committed at their new size yet
+    struct wl_event_source *transaction_timer;
+    int transaction_waiting;
+    int64_t transaction_start_ns;
+    uint64_t tile_counter;
+    uint64_t transactions;
+    uint64_t transactions_timed_out;
+    int64_t transaction_time_ns;
+
+    struct wlr_xdg_shell *xdg_shell;
+    struct wl_listener new_xdg_toplevel;
+    struct wl_listener new_xdg_popup;
+    struct wl_list toplevels;
+
+    struct wlr_cursor *cursor;
+    struct wlr_xcursor_manager *cursor_mgr;
+    // Theme cursor currently shown, NULL while a client surface is the cursor. See cursor_set_xcursor()
+    const char *cursor_xcursor;
+    uint64_t cursor_image_changes;
+    uint64_t cursor_sets_skipped;
+    struct wlr_cursor_shape_manager_v1 *cursor_shape_manager;
+    struct wl_listener request_set_shape;
+    struct wl_listener cursor_motion;
+    struct wl_listener cursor_motion_absolute;
+    struct wl_listener cursor_button;
+    struct wl_listener cursor_axis;
+    struct wl_listener cursor_frame;
+
+    struct wlr_seat *seat;
+    struct wl_listener new_input;
+    struct wl_listener request_cursor;
+    struct wl_listener pointer_focus_change;
+    struct wl_listener request_set_selection;
+    struct wl_list keyboards;
+    // One xkb context for every keyboard, and compiled keymaps keyed by RMLVO, see keymap.c
+    struct xkb_context *xkb_context;
+    struct wl_list keymaps;
+    bool keymap_disk_cache;
+    uint64_t keymap_compiles;
+    uint64_t keymap_cache_hits;
+    int64_t keymap_compile_ns;
+    enum pwc_cursor_mode cursor_mode;
+    struct pwc_toplevel *grabbed_toplevel;
+    double grab_x, grab_y;
+    struct wlr_box grab_geobox;
+    uint32_t resize_edges;
+    struct pwc_hit_index hit_index;
+
+    // Relative motion is always delivered per event, for games and anything else that wants raw deltas
+    struct wlr_relative_pointer_manager_v1 *relative_pointer_manager;
+    // Pointer lock and confinement. While a constraint is active the pointer can't leave its surface, so motion..
+    // skips the hit test and goes straight to it. constraint_x/y is the surface origin in layout coordinates
+    struct wlr_pointer_constraints_v1 *pointer_constraints;
+    struct wl_listener new_pointer_constraint;
+    struct wl_listener keyboard_focus_change;
+    struct wlr_pointer_constraint_v1 *active_constraint;
+    double constraint_x, constraint_y;
+    uint64_t motion_constrained;
+    // Drawing tablets and their pads, see tablet.c
+    struct wlr_tablet_manager_v2 *tablet_manager;
+    struct wl_list tablets;
+    struct wl_list tablet_tools;
+    struct wl_list tablet_pads;
+    struct wl_listener cursor_tablet_tool_axis;
+    struct wl_listener cursor_tablet_tool_proximity;
+    struct wl_listener cursor_tablet_tool_tip;
+    struct wl_listener cursor_tablet_tool_button;
+    uint64_t tablet_events;
+    uint64_t tablet_hit_tests;
+    // With coalesce_motion, pointer motion only moves the cursor image right away. Hit-testing, seat notifies and..
+    // interactive move/resize run once after the event loop has drained the pending input, see server_flush_motion()
+    bool coalesce_motion;
+    bool motion_pending;
+    bool motion_frame_pending;
+    uint32_t motion_time_msec;
+    struct wl_event_source *motion_idle;
+    uint64_t motion_events;
+    uint64_t motion_coalesced;
+    // Interactive resize configures sent, and sizes superseded while a configure was in flight
+    uint64_t resize_configures;
+    uint64_t resize_superseded;
+
+    struct wlr_output_layout *output_layout;
+    struct wl_list outputs;
+    struct wl_listener new_output;
+    struct wl_list output_configs;
+    struct wlr_output_manager_v1 *output_manager;
+    struct wl_listener output_manager_apply;
+    struct wl_listener output_manager_test;
+    struct wl_listener output_layout_change;
+
+    struct wlr_tearing_control_manager_v1 *tearing_control;
+
+    // Screen capture. Toplevel capture sources are created on demand, see server_new_toplevel_capture_request()
+    struct wlr_ext_foreign_toplevel_list_v1 *foreign_toplevel_list;
+    struct wlr_ext_foreign_toplevel_image_capture_source_manager_v1 *toplevel_capture_manager;
+    struct wl_listener new_toplevel_capture_request;
+    // Title and app_id changes are sent to foreign toplevel list clients at most once per frame
+    struct wl_event_source *foreign_update_timer;
+    bool foreign_flush_pending;
+
+    // Slow frame clock for surfaces the scene considers hidden. surfaces_occluded is the count as of the last tick
+    struct wl_event_source *occlusion_timer;
+    struct wl_listener occlusion_new_surface;
+    bool occlusion_armed;
+    uint64_t surfaces_occluded;
+    uint64_t surfaces_occluded_max;
+    uint64_t occluded_frames_sent;
+    uint64_t foreign_updates;
+    uint64_t foreign_updates_sent;
+
+    // Delay compositing until just before the vblank instead of rendering as soon as the frame event fires
+    bool render_late;
+
+    struct wl_event_source *stats_source;
+    // Log level given with -v. SIGHUP switches between it and debug
+    enum wlr_log_importance log_verbosity;
+    struct wl_event_source *log_level_source;
+
+    // Startup profile and the setup deferred until the first frame is presented, see startup.c. startup_cmd (-s)..
+    // is launched once that is done
+    bool startup_profile;
+    const char *startup_cmd;
+    bool startup_done;
+    int64_t startup_start_ns;
+    int64_t startup_mark_ns;
+    int64_t first_frame_ns;
+    struct pwc_startup_phase startup_phases[PWC_STARTUP_PHASES];
+    int startup_phase_count;
+    struct wl_event_source *startup_timer;
+    struct wl_event_source *startup_idle;
+
+    // Trace recording written to trace_path, started at launch when -T is given. SIGUSR2 toggles it, see trace.c
+    const char *trace_path;
+    struct wl_event_source *trace_source;
+
+    // Command run by Alt+Return. Launched children are reaped from SIGCHLD, see launcher.c
+    const char *terminal_cmd;
+    struct wl_event_source *sigchld_source;
+
+    // Xwayland, started on demand, see xwayland.c. NULL when built without it
+    struct wlr_xwayland *xwayland;
+    struct wlr_xwayland_server *xwayland_server;
+    struct wl_listener xwayland_start;
+    struct wl_listener xwayland_ready;
+    struct wl_listener xwayland_new_surface;
+    int64_t xwayland_start_ns;
+    uint64_t xwayland_starts;
+    uint64_t spawns;
+    int64_t spawn_time_ns;
+    int64_t spawn_time_max_ns;
+};
+
+struct pwc_output {
+    struct wl_list link;
+    struct pwc_server *server;
+    struct wlr_output *wlr_output;
+    struct pwc_output_config *config;
+    struct wl_listener frame;
+    struct wl_listener request_state;
+    struct wl_listener present;
+    struct wl_listener bind;
+    struct wl_listener destroy;
+
+    // Frame scheduling stats. A frame is committed when the scene had damage, skipped otherwise
+    uint64_t frames_committed;
+    uint64_t frames_skipped;
+    // Frames presented with an async page flip, and frames where the backend refused one
+    uint64_t frames_torn;
+    uint64_t tearing_refused;
+    // Whether the last frame went straight to the primary plane, and if not, the best guess as to why
+    bool direct_scanout;
+    const char *scanout_blocker;
+    uint64_t frames_scanned_out;
+    // Set once the backend refused to enable adaptive sync, so it isn't retried every frame
+    bool vrr_refused;
+
+    // Render deadline scheduling. Recent composite times predict how late rendering can start..
+    // and the margin grows every time a frame misses the vblank it was aimed at.
+    struct wl_event_source *render_timer;
+    bool render_scheduled;
+    int64_t render_times_ns[PWC_RENDER_SAMPLES];
+    size_t render_time_index;
+    int64_t render_margin_ns;
+    int64_t last_present_ns;
+    int64_t refresh_ns;
+    int64_t target_present_ns;
+    uint64_t deadlines_missed;
+
+    // Vblanks between consecutive presented frames. Anything past the first bucket while frames are committed..
+    // back to back is a missed vblank. An interval is only counted when the frame was committed from the frame event..
+    // right after the previous present, a skipped or dropped frame in between means the output was idle
+    uint64_t last_present_seq;
+    bool present_back_to_back;
+    uint64_t present_intervals[PWC_PRESENT_BUCKETS];
+    uint64_t frames_discarded;
+};
+
+struct pwc_toplevel {
+    struct wl_list link;
+    struct pwc_server *server;
+    struct wlr_xdg_toplevel *xdg_toplevel;
+    // Set instead of xdg_toplevel for X11 windows. Unmanaged ones (override-redirect menus and tooltips) place..
+    // themselves and stay out of focus cycling, tiling and the foreign toplevel list
+    struct wlr_xwayland_surface *xwayland_surface;
+    bool unmanaged;
+    struct wlr_scene_tree *scene_tree;
+    struct pwc_workspace *workspace;
+    struct wl_listener map;
+    struct wl_listener unmap;
+    struct wl_listener commit;
+    struct wl_listener destroy;
+    struct wl_listener request_move;
+    struct wl_listener request_resize;
+    struct wl_listener request_maximize;
+    struct wl_listener request_fullscreen;
+    struct wl_listener ack_configure;
+    struct wl_listener set_title;
+    struct wl_listener set_app_id;
+    // X11 only
+    struct wl_listener associate;
+    struct wl_listener dissociate;
+    struct wl_listener request_configure;
+    struct wl_listener request_activate;
+    struct wl_listener set_geometry;
+
+    // Interactive resize pacing, at most one configure in flight. wanted is the latest geometry the grab asked for,..
+    // sent is the one in the configure in flight and acked the one the next commit is positioned against. serial..
+    // belongs to sent, acked_serial to acked
+    struct {
+        struct wlr_box wanted, sent, acked;
+        uint32_t edges;
+        uint32_t serial;
+        uint32_t acked_serial;
+        bool in_flight;
+        bool pending;
+        bool reposition;
+    } resize;
+
+    // Tiling state. seq is the creation order tiles are laid out in, box the tile of the current transaction and..
+    // snapshot the frozen copy of the window shown while the client catches up
+    struct {
+        uint64_t seq;
+        struct wlr_box box;
+        uint32_t serial;
+        bool in_transaction;
+        bool waiting;
+        struct wlr_scene_tree *snapshot;
+    } tile;
+
+    // Output the toplevel is fullscreen on, NULL when windowed. saved_box is the windowed position and size
+    struct wlr_output *fullscreen_output;
+    struct wlr_box saved_box;
+    // Black fill behind a fullscreen window covering its whole output. Being opaque, it also hides everything..
+    // underneath from the scene, which stops their frame callbacks
+    struct wlr_scene_rect *fullscreen_backdrop;
+
+    // Layout-coordinate bounds of the whole subtree as last indexed, and its position in the stacking order
+    struct wlr_box hit_box;
+    bool hit_indexed;
+    int hit_buffers;
+    uint32_t hit_layout_hash;
+    uint64_t stack_seq;
+
+    // Handle advertised to ext-foreign-toplevel-list clients while mapped
+    struct wlr_ext_foreign_toplevel_handle_v1 *foreign_handle;
+    bool foreign_dirty;
+    // Capture source for this window. It renders a scene of its own so other windows never occlude it
+    struct wlr_scene *image_capture_scene;
+    struct wlr_ext_image_capture_source_v1 *image_capture_source;
+};
+
+struct pwc_pointer_constraint {
+    struct pwc_server *server;
+    struct wlr_pointer_constraint_v1 *wlr_constraint;
+    struct wl_listener set_region;
+    struct wl_listener destroy;
+};
+
+struct pwc_tablet {
+    struct wl_list link;
+    struct pwc_server *server;
+    struct wlr_tablet *wlr_tablet;
+    struct wlr_tablet_v2_tablet *tablet_v2;
+    struct wl_listener destroy;
+};
+
+struct pwc_tablet_tool {
+    struct pwc_server *server;
+    struct wlr_tablet_tool *wlr_tool;
+    struct wlr_tablet_v2_tablet_tool *tool_v2;
+    struct wl_list link;
+    // Layout position of the focused surface's origin, and the window under the tool, from the last hit test
+    double surface_x, surface_y;
+    struct pwc_toplevel *toplevel;
+    struct wl_listener set_cursor;
+    struct wl_listener destroy;
+};
+
+struct pwc_tablet_pad {
+    struct wl_list link;
+    struct pwc_server *server;
+    struct wlr_tablet_v2_tablet_pad *pad_v2;
+    struct wlr_surface *focused_surface;
+    struct wl_listener button;
+    struct wl_listener ring;
+    struct wl_listener strip;
+    struct wl_listener surface_destroy;
+    struct wl_listener destroy;
+};
+
+struct pwc_popup {
+    struct wlr_xdg_popup *xdg_popup;
+    // Toplevel the popup chain belongs to, or NULL if its parent isn't one of ours
+    struct pwc_toplevel *toplevel;
+    struct wl_listener commit;
+    struct wl_listener destroy;
+};
+
+struct pwc_keyboard {
+    struct wl_list link;
+    struct pwc_server *server;
+    struct wlr_keyboard *wlr_keyboard;
+
+    struct wl_listener modifiers;
+    struct wl_listener key;
+    struct wl_listener destroy;
+};
+
+static inline int64_t timespec_to_ns(const struct timespec *ts){
+    return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static inline int64_t get_time_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespec_to_ns(&now);
+}
+
+// trace.c
+extern bool trace_active;
+bool trace_init(struct pwc_server *server);
+void trace_finish(struct pwc_server *server);
+void trace_start(void);
+void trace_stop(void);
+void trace_span(enum pwc_trace_track track, const char *name, int64_t start_ns, const char *detail);
+void trace_instant_at(enum pwc_trace_track track, const char *name, int64_t when_ns, const char *detail);
+
+static inline int64_t trace_begin(void){
+    // Start of a span, ended with trace_end(). Free apart from the branch while nothing is recording
+    return trace_active ? get_time_ns() : 0;
+}
+
+static inline void trace_end(enum pwc_trace_track track, const char *name, int64_t start_ns, const char *detail){
+    // name has to be a string literal, detail is copied
+    if (start_ns != 0) trace_span(track, name, start_ns, detail);
+}
+
+static inline void trace_instant(enum pwc_trace_track track, const char *name, const char *detail){
+    if (trace_active) trace_instant_at(track, name, get_time_ns(), detail);
+}
+
+// server.c
+bool server_init(struct pwc_server *server);
+void server_finish(struct pwc_server *server);
+void server_log_stats(struct pwc_server *server);
+void server_init_deferred(struct pwc_server *server);
+
+// keymap.c
+bool keymap_cache_init(struct pwc_server *server);
+void keymap_cache_finish(struct pwc_server *server);
+struct xkb_keymap *keymap_cache_get(struct pwc_server *server, const struct xkb_rule_names *names);
+
+// layout.c
+bool layout_init(struct pwc_server *server);
+void layout_finish(struct pwc_server *server);
+void layout_arrange(struct pwc_workspace *workspace);
+void layout_toggle(struct pwc_workspace *workspace);
+void layout_toplevel_commit(struct pwc_toplevel *toplevel);
+void layout_toplevel_remove(struct pwc_toplevel *toplevel);
+
+// logger.c
+bool logger_init(enum wlr_log_importance verbosity, const char *path);
+void logger_finish(void);
+void logger_set_verbosity(enum wlr_log_importance verbosity);
+void logger_stats(uint64_t *written, uint64_t *dropped);
+bool logger_parse_level(const char *name, enum wlr_log_importance *verbosity);
+
+// launcher.c
+bool launcher_init(struct pwc_server *server);
+void launcher_finish(struct pwc_server *server);
+pid_t launcher_spawn(struct pwc_server *server, const char *command);
+
+// startup.c
+void startup_begin(struct pwc_server *server);
+void startup_phase(struct pwc_server *server, const char *name);
+void startup_frame_presented(struct pwc_server *server, int64_t when_ns);
+bool startup_init(struct pwc_server *server);
+void startup_finish(struct pwc_server *server);
+
+// occlusion.c
+bool occlusion_init(struct pwc_server *server);
+void occlusion_finish(struct pwc_server *server);
+void occlusion_scene_changed(struct pwc_server *server);
+
+// output.c
+void server_new_output(struct wl_listener *listener, void *data);
+int64_t output_render_budget(struct pwc_output *output);
+void output_add_to_layout(struct pwc_output *output, bool has_position, int x, int y);
+
+// output_config.c
+bool output_config_parse(struct pwc_server *server, const char *spec);
+void output_configs_finish(struct pwc_server *server);
+struct pwc_output_config *output_config_find(struct pwc_server *server, const char *name);
+void output_config_apply(struct wlr_output *wlr_output, struct pwc_output_config *config, struct wlr_output_state *state);
+bool output_manager_init(struct pwc_server *server);
+void output_manager_finish(struct pwc_server *server);
+
+// input.c
+void server_new_input(struct wl_listener *listener, void *data);
+void cursor_set_xcursor(struct pwc_server *server, const char *name);
+void seat_request_cursor(struct wl_listener *listener, void *data);
+void seat_request_set_shape(struct wl_listener *listener, void *data);
+void seat_pointer_focus_change(struct wl_listener *listener, void *data);
+void seat_request_set_selection(struct wl_listener *listener, void *data);
+void seat_keyboard_focus_change(struct wl_listener *listener, void *data);
+void server_new_pointer_constraint(struct wl_listener *listener, void *data);
+void server_cursor_motion(struct wl_listener *listener, void *data);
+void server_cursor_motion_absolute(struct wl_listener *listener, void *data);
+void server_cursor_button(struct wl_listener *listener, void *data);
+void server_cursor_axis(struct wl_listener *listener, void *data);
+void server_cursor_frame(struct wl_listener *listener, void *data);
+void reset_cursor_mode(struct pwc_server *server);
+bool cursor_grab_motion(struct pwc_server *server);
+void cursor_pointer_focus(struct pwc_server *server, uint32_t time, struct wlr_surface *surface, double sx, double sy);
+void cursor_button(struct pwc_server *server, uint32_t time_msec, uint32_t button, uint32_t state);
+void cursor_rebase(struct pwc_server *server);
+void server_flush_motion(struct pwc_server *server);
+
+// tablet.c
+void server_new_tablet(struct pwc_server *server, struct wlr_input_device *device);
+void server_new_tablet_pad(struct pwc_server *server, struct wlr_input_device *device);
+void tablet_pads_focus(struct pwc_server *server, struct wlr_surface *surface);
+void tablet_tools_forget(struct pwc_toplevel *toplevel);
+void server_tablet_tool_axis(struct wl_listener *listener, void *data);
+void server_tablet_tool_proximity(struct wl_listener *listener, void *data);
+void server_tablet_tool_tip(struct wl_listener *listener, void *data);
+void server_tablet_tool_button(struct wl_listener *listener, void *data);
+
+// hit_index.c
+void hit_index_init(struct pwc_hit_index *index);
+void hit_index_finish(struct pwc_hit_index *index);
+void hit_index_update(struct pwc_server *server, struct pwc_toplevel *toplevel);
+void hit_index_remove(struct pwc_server *server, struct pwc_toplevel *toplevel);
+void hit_index_raise(struct pwc_server *server, struct pwc_toplevel *toplevel);
+void hit_index_invalidate(struct pwc_server *server);
+struct pwc_toplevel *desktop_toplevel_at(struct pwc_server *server, double lx, double ly, struct wlr_surface **surface, double *sx, double *sy);
+
+// workspace.c
+bool workspaces_init(struct pwc_server *server);
+void workspaces_finish(struct pwc_server *server);
+void workspace_activate(struct pwc_workspace *workspace);
+void workspace_output_bind(struct pwc_server *server, struct wl_resource *output_resource);
+void workspace_output_remove(struct pwc_server *server, struct wlr_output *wlr_output);
+
+// xwayland.c
+bool xwayland_init(struct pwc_server *server);
+void xwayland_finish(struct pwc_server *server);
+
+// xdg.c
+struct wlr_surface *toplevel_surface(struct pwc_toplevel *toplevel);
+void toplevel_get_geometry(struct pwc_toplevel *toplevel, struct wlr_box *box);
+void toplevel_set_position(struct pwc_toplevel *toplevel, int x, int y);
+void surface_set_activated(struct wlr_surface *surface, bool activated);
+void toplevel_map(struct pwc_toplevel *toplevel);
+void toplevel_unmap(struct pwc_toplevel *toplevel);
+void toplevel_queue_foreign_update(struct pwc_toplevel *toplevel);
+void begin_interactive(struct pwc_toplevel *toplevel, enum pwc_cursor_mode mode, uint32_t edges);
+void server_new_xdg_toplevel(struct wl_listener *listener, void *data);
+void server_new_xdg_popup(struct wl_listener *listener, void *data);
+void server_new_toplevel_capture_request(struct wl_listener *listener, void *data);
+int server_flush_foreign_toplevels(void *data);
+void focus_toplevel(struct pwc_toplevel *toplevel);
+void toplevel_set_fullscreen(struct pwc_toplevel *toplevel, bool fullscreen, struct wlr_output *wlr_output);
+void toplevel_resize(struct pwc_toplevel *toplevel, const struct wlr_box *box, uint32_t edges);
+
+#endif
@@ -0,0 +1,299 @@
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/box.h>
+#include <wlr/util/log.h>
+#include "server.h"
+
+// Spatial index for pointer hit-testing. Toplevels are bucketed into a coarse grid by the bounds of their whole..
+// scene subtree (popups and subsurfaces included). A hit-test only runs wlr_scene_node_at() on the toplevels..
+// whose bounds contain the point, topmost first, instead of walking the entire scene.
+
+// Upper bound on toplevels overlapping a single point before giving up and walking the whole scene
+#define PWC_HIT_MAX_CANDIDATES 64
+
+struct pwc_hit_cell {
+    struct wl_list link;
+    int x, y;
+    struct wl_array toplevels; // struct pwc_toplevel *
+};
+
+static struct wl_list *hit_bucket(struct pwc_hit_index *index, int x, int y){
+    unsigned int hash = ((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u);
+    return &index->buckets[hash % PWC_HIT_BUCKETS];
+}
+
+static struct pwc_hit_cell *hit_cell_get(struct pwc_hit_index *index, int x, int y, bool create){
+    struct wl_list *bucket = hit_bucket(index, x, y);
+    struct pwc_hit_cell *cell;
+    wl_list_for_each(cell, bucket, link){
+        if (cell->x == x && cell->y == y) return cell;
+    }
+    if (!create) return NULL;
+    cell = calloc(1, sizeof(*cell));
+    if (cell == NULL) return NULL;
+    cell->x = x;
+    cell->y = y;
+    wl_array_init(&cell->toplevels);
+    wl_list_insert(bucket, &cell->link);
+    return cell;
+}
+
+static int cell_coord(int v){
+    // Floor division so negative layout coordinates land in the right cell
+    return v >= 0 ? v / PWC_HIT_CELL_SIZE : -((-v - 1) / PWC_HIT_CELL_SIZE) - 1;
+}
+
+static void hit_cells_remove(struct pwc_hit_index *index, struct pwc_toplevel *toplevel){
+    struct wlr_box *box = &toplevel->hit_box;
+    for (int y = cell_coord(box->y); y <= cell_coord(box->y + box->height - 1); y++){
+        for (int x = cell_coord(box->x); x <= cell_coord(box->x + box->width - 1); x++){
+            struct pwc_hit_cell *cell = hit_cell_get(index, x, y, false);
+            if (cell == NULL) continue;
+            struct pwc_toplevel **entries = cell->toplevels.data;
+            size_t len = cell->toplevels.size / sizeof(*entries);
+            for (size_t i = 0; i < len; i++){
+                if (entries[i] != toplevel) continue;
+                entries[i] = entries[len - 1];
+                cell->toplevels.size -= sizeof(*entries);
+                break;
+            }
+            if (cell->toplevels.size == 0){
+                wl_list_remove(&cell->link);
+                wl_array_release(&cell->toplevels);
+                free(cell);
+            }
+        }
+    }
+}
+
+static void hit_cells_insert(struct pwc_hit_index *index, struct pwc_toplevel *toplevel){
+    struct wlr_box *box = &toplevel->hit_box;
+    for (int y = cell_coord(box->y); y <= cell_coord(box->y + box->height - 1); y++){
+        for (int x = cell_coord(box->x); x <= cell_coord(box->x + box->width - 1); x++){
+            struct pwc_hit_cell *cell = hit_cell_get(index, x, y, true);
+            if (cell == NULL) continue;
+            struct pwc_toplevel **entry = wl_array_add(&cell->toplevels, sizeof(*entry));
+            if (entry != NULL) *entry = toplevel;
+        }
+    }
+}
+
+static void hit_cache_clear(struct pwc_hit_index *index){
+    if (index->cache.surface != NULL) wl_list_remove(&index->cache.surface_destroy.link);
+    index->cache.surface = NULL;
+    index->cache.toplevel = NULL;
+}
+
+static void hit_cache_handle_surface_destroy(struct wl_listener *listener, void *data){
+    struct pwc_hit_index *index = wl_container_of(listener, index, cache.surface_destroy);
+    hit_cache_clear(index);
+}
+
+void hit_index_init(struct pwc_hit_index *index){
+    for (size_t i = 0; i < PWC_HIT_BUCKETS; i++) wl_list_init(&index->buckets[i]);
+    index->cache.surface_destroy.notify = hit_cache_handle_surface_destroy;
+}
+
+void hit_index_finish(struct pwc_hit_index *index){
+    hit_cache_clear(index);
+    for (size_t i = 0; i < PWC_HIT_BUCKETS; i++){
+        struct pwc_hit_cell *cell, *tmp;
+        wl_list_for_each_safe(cell, tmp, &index->buckets[i], link){
+            wl_list_remove(&cell->link);
+            wl_array_release(&cell->toplevels);
+            free(cell);
+        }
+    }
+}
+
+struct hit_bounds {
+    struct wlr_box box;
+    uint32_t layout_hash;
+    int buffers;
+};
+
+static void hit_bounds_add(struct hit_bounds *bounds, int sx, int sy, int width, int height){
+    // Hash of every buffer box, so moving a subsurface inside unchanged bounds still invalidates the cache
+    bounds->layout_hash = bounds->layout_hash * 31 + (uint32_t)sx;
+    bounds->layout_hash = bounds->layout_hash * 31 + (uint32_t)sy;
+    bounds->layout_hash = bounds->layout_hash * 31 + (uint32_t)width;
+    bounds->layout_hash = bounds->layout_hash * 31 + (uint32_t)height;
+
+    if (wlr_box_empty(&bounds->box)){
+        bounds->box = (struct wlr_box){ sx, sy, width, height };
+        return;
+    }
+    int x2 = bounds->box.x + bounds->box.width, y2 = bounds->box.y + bounds->box.height;
+    if (sx + width > x2) x2 = sx + width;
+    if (sy + height > y2) y2 = sy + height;
+    if (sx < bounds->box.x) bounds->box.x = sx;
+    if (sy < bounds->box.y) bounds->box.y = sy;
+    bounds->box.width = x2 - bounds->box.x;
+    bounds->box.height = y2 - bounds->box.y;
+}
+
+static void hit_bounds_iter(struct wlr_scene_buffer *buffer, int sx, int sy, void *data){
+    struct hit_bounds *bounds = data;
+    int width = buffer->dst_width, height = buffer->dst_height;
+    if ((width == 0 || height == 0) && buffer->buffer != NULL){
+        width = buffer->buffer->width;
+        height = buffer->buffer->height;
+    }
+    if (width <= 0 || height <= 0) return;
+    bounds->buffers++;
+    hit_bounds_add(bounds, sx, sy, width, height);
+}
+
+void hit_index_update(struct pwc_server *server, struct pwc_toplevel *toplevel){
+    // Recomputes the bounds of a toplevel's subtree and moves it to the right cells. Called whenever the toplevel..
+    // or one of its popups is mapped, moved or resized
+    struct pwc_hit_index *index = &server->hit_index;
+    struct hit_bounds bounds = {0};
+    int x = 0, y = 0;
+    if (wlr_scene_node_coords(&toplevel->scene_tree->node, &x, &y)){
+        wlr_scene_node_for_each_buffer(&toplevel->scene_tree->node, hit_bounds_iter, &bounds);
+        // The fullscreen backdrop takes input too, or the pointer would reach the windows hidden behind it
+        struct wlr_scene_rect *backdrop = toplevel->fullscreen_backdrop;
+        if (backdrop != NULL && backdrop->node.enabled){
+            hit_bounds_add(&bounds, toplevel->scene_tree->node.x + backdrop->node.x, toplevel->scene_tree->node.y + backdrop->node.y,
+                    backdrop->width, backdrop->height);
+        }
+    }
+    // for_each_buffer reports coordinates relative to the parent of the toplevel's tree
+    bounds.box.x += x - toplevel->scene_tree->node.x;
+    bounds.box.y += y - toplevel->scene_tree->node.y;
+
+    bool moved = !toplevel->hit_indexed || !wlr_box_equal(&bounds.box, &toplevel->hit_box);
+    if (!moved && bounds.layout_hash == toplevel->hit_layout_hash) return;
+    index->generation++;
+    toplevel->hit_layout_hash = bounds.layout_hash;
+    toplevel->hit_buffers = bounds.buffers;
+    if (!moved) return;
+
+    if (toplevel->hit_indexed) hit_cells_remove(index, toplevel);
+    toplevel->hit_box = bounds.box;
+    toplevel->hit_indexed = !wlr_box_empty(&bounds.box);
+    if (toplevel->hit_indexed) hit_cells_insert(index, toplevel);
+}
+
+void hit_index_remove(struct pwc_server *server, struct pwc_toplevel *toplevel){
+    struct pwc_hit_index *index = &server->hit_index;
+    if (index->cache.toplevel == toplevel) hit_cache_clear(index);
+    index->generation++;
+    if (!toplevel->hit_indexed) return;
+    hit_cells_remove(index, toplevel);
+    toplevel->hit_indexed = false;
+}
+
+void hit_index_raise(struct pwc_server *server, struct pwc_toplevel *toplevel){
+    // Mirrors wlr_scene_node_raise_to_top() for stacking order between candidates
+    toplevel->stack_seq = ++server->hit_index.stack_counter;
+    server->hit_index.generation++;
+}
+
+void hit_index_invalidate(struct pwc_server *server){
+    // Something changed that the index can't see (e.g. a popup went away), drop the cached hit
+    server->hit_index.generation++;
+}
+
+static uint64_t stack_key(struct pwc_toplevel *toplevel){
+    // The fullscreen tree, which also holds unmanaged X11 windows, is stacked above all other toplevels
+    return ((uint64_t)(toplevel->fullscreen_output != NULL || toplevel->unmanaged) << 63) | toplevel->stack_seq;
+}
+
+static struct pwc_toplevel *scene_toplevel_at(struct wlr_scene_node *root, double lx, double ly, struct wlr_surface **surface, double *sx, double *sy){
+    // Hit-tests a scene subtree and maps the buffer found back to its pwc_toplevel. A rect inside a toplevel's tree..
+    // (the fullscreen backdrop) is that toplevel without a surface
+    struct wlr_scene_node *node = wlr_scene_node_at(root, lx, ly, sx, sy);
+    if (node == NULL) return NULL;
+    if (node->type == WLR_SCENE_NODE_RECT) *surface = NULL;
+    else if (node->type == WLR_SCENE_NODE_BUFFER){
+        struct wlr_scene_surface *scene_surface = wlr_scene_surface_try_from_buffer(wlr_scene_buffer_from_node(node));
+        if (!scene_surface) return NULL;
+        *surface = scene_surface->surface;
+    }
+    else return NULL;
+    // Find the corresponding node to the pwc_toplevel at the root of this surface tree
+    struct wlr_scene_tree *tree = node->parent;
+    while (tree != NULL && tree->node.data == NULL) tree = tree->node.parent;
+    return tree != NULL ? tree->node.data : NULL;
+}
+
+static struct pwc_toplevel *hit_index_lookup(struct pwc_server *server, struct pwc_hit_cell *cell, double lx, double ly, struct wlr_surface **surface, double *sx, double *sy){
+    if (cell == NULL) return NULL;
+
+    // Collect the toplevels whose bounds contain the point, sorted topmost first
+    struct pwc_toplevel *candidates[PWC_HIT_MAX_CANDIDATES];
+    size_t count = 0;
+    struct pwc_toplevel **entry;
+    wl_array_for_each(entry, &cell->toplevels){
+        if (!wlr_box_contains_point(&(*entry)->hit_box, lx, ly)) continue;
+        if (count == PWC_HIT_MAX_CANDIDATES){
+            return scene_toplevel_at(&server->scene->tree.node, lx, ly, surface, sx, sy);
+        }
+        size_t i = count++;
+        while (i > 0 && stack_key(candidates[i - 1]) < stack_key(*entry)){
+            candidates[i] = candidates[i - 1];
+            i--;
+        }
+        candidates[i] = *entry;
+    }
+
+    for (size_t i = 0; i < count; i++){
+        struct pwc_toplevel *toplevel = scene_toplevel_at(&candidates[i]->scene_tree->node, lx, ly, surface, sx, sy);
+        if (toplevel != NULL) return toplevel;
+    }
+    return NULL;
+}
+
+struct pwc_toplevel *desktop_toplevel_at(struct pwc_server *server, double lx, double ly, struct wlr_surface **surface, double *sx, double *sy){
+    // This returns the topmost toplevel and surface at the given layout coords
+    struct pwc_hit_index *index = &server->hit_index;
+    int64_t start = get_time_ns();
+    index->hit_tests++;
+
+    // Fast path: nothing moved or restacked since the last hit and the point is still over the same surface
+    double cx = lx - index->cache.origin_x, cy = ly - index->cache.origin_y;
+    if (index->cache.surface != NULL && index->cache.generation == index->generation &&
+            wlr_box_contains_point(&index->cache.box, lx, ly) && wlr_surface_point_accepts_input(index->cache.surface, cx, cy)){
+        *surface = index->cache.surface;
+        *sx = cx;
+        *sy = cy;
+        index->cache_hits++;
+        index->time_ns += get_time_ns() - start;
+        return index->cache.toplevel;
+    }
+
+    int ix = (int)lx, iy = (int)ly;
+    if (lx < ix) ix--;
+    if (ly < iy) iy--;
+    struct pwc_hit_cell *cell = hit_cell_get(index, cell_coord(ix), cell_coord(iy), false);
+    struct pwc_toplevel *toplevel = hit_index_lookup(server, cell, lx, ly, surface, sx, sy);
+
+    // Only cache when nothing else can cover the surface: the toplevel is a single buffer and alone in its cell.
+    // The cached box is clipped to the cell so the fast path never has to look at other toplevels
+    hit_cache_clear(index);
+    if (toplevel != NULL && *surface != NULL && toplevel->hit_buffers == 1 && cell->toplevels.size == sizeof(toplevel)){
+        struct wlr_box surface_box = {
+            .x = (int)(lx - *sx), .y = (int)(ly - *sy),
+            .width = (*surface)->current.width, .height = (*surface)->current.height,
+        };
+        struct wlr_box cell_box = {
+            .x = cell->x * PWC_HIT_CELL_SIZE, .y = cell->y * PWC_HIT_CELL_SIZE,
+            .width = PWC_HIT_CELL_SIZE, .height = PWC_HIT_CELL_SIZE,
+        };
+        if (wlr_box_intersection(&index->cache.box, &surface_box, &cell_box)){
+            index->cache.toplevel = toplevel;
+            index->cache.surface = *surface;
+            index->cache.origin_x = surface_box.x;
+            index->cache.origin_y = surface_box.y;
+            index->cache.generation = index->generation;
+            wl_signal_add(&(*surface)->events.destroy, &index->cache.surface_destroy);
+        }
+    }
+    index->time_ns += get_time_ns() - start;
+    return toplevel;
+}
@@ -0,0 +1,546 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_cursor_shape_v1.h>
+#include <wlr/types/wlr_input_device.h>
+#include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_pointer_constraints_v1.h>
+#include <wlr/types/wlr_relative_pointer_v1.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_tablet_v2.h>
+#include <wlr/types/wlr_xcursor_manager.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/edges.h>
+#include <wlr/util/log.h>
+#include <wlr/util/region.h>
+#include <xkbcommon/xkbcommon.h>
+#include "server.h"
+
+static void keyboard_handle_modifiers(struct wl_listener *listener, void *data){
+    // Event is raised when a modifier key is pressed
+    struct pwc_keyboard *keyboard = wl_container_of(listener, keyboard, modifiers);
+    // Seat can only have one keyboard because of the Wayland protocall.
+    // All keyboards asre assigned as one in the same seat
+    wlr_seat_set_keyboard(keyboard->server->seat, keyboard->wlr_keyboard);
+    wlr_seat_keyboard_notify_modifiers(keyboard->server->seat, &keyboard->wlr_keyboard->modifiers);
+}
+
+static bool handle_keybindings(struct pwc_server *server, xkb_keysym_t sym){
+    // Handle compositor keybinds. Compositor is processing and not passing keys. Assumes alt is held down.
+    switch (sym){
+        case XKB_KEY_Escape:
+            wl_display_terminate(server->wl_display);
+            break;
+        case XKB_KEY_F1:{
+            // Cycle to the least recently focused toplevel on the active workspace
+            struct pwc_toplevel *toplevel, *next_toplevel = NULL;
+            wl_list_for_each_reverse(toplevel, &server->toplevels, link){
+                if (toplevel->workspace == server->active_workspace && !toplevel->unmanaged){next_toplevel = toplevel; break;}
+            }
+            if (next_toplevel != NULL) focus_toplevel(next_toplevel);
+            break;
+        }
+        case XKB_KEY_space:
+            // Toggle tiling on the active workspace
+            layout_toggle(server->active_workspace);
+            break;
+        case XKB_KEY_1: case XKB_KEY_2: case XKB_KEY_3: case XKB_KEY_4: case XKB_KEY_5:
+        case XKB_KEY_6: case XKB_KEY_7: case XKB_KEY_8: case XKB_KEY_9:
+            // Switch workspace
+            workspace_activate(&server->workspaces[sym - XKB_KEY_1]);
+            break;
+        case XKB_KEY_Return:
+            // Open terminal
+            launcher_spawn(server, server->terminal_cmd != NULL ? server->terminal_cmd : PWC_DEFAULT_TERMINAL);
+            break;
+        default: return false;
+    }
+    return true;
+}
+
+static void keyboard_handle_key(struct wl_listener *listener, void *data){
+    // Event is raised when a key is pressed or released
+    struct pwc_keyboard *keyboard = wl_container_of(listener,keyboard,key);
+    struct pwc_server *server = keyboard->server;
+    struct wlr_keyboard_key_event *event = data;
+    struct wlr_seat *seat = server->seat;
+    int64_t trace_start_ns = trace_begin();
+
+    // Translate libinput keycode -> xkbcommon
+    uint32_t keycode = event->keycode + 8;
+    // Get list of keysyms based on the keymap for this keyboard
+    const xkb_keysym_t *syms;
+    int nsyms = xkb_state_key_get_syms(keyboard->wlr_keyboard->xkb_state, keycode , &syms);
+
+    bool handled = false;
+    uint32_t modifiers = wlr_keyboard_get_modifiers(keyboard->wlr_keyboard);
+    if ((modifiers & WLR_MODIFIER_ALT) && event->state == WL_KEYBOARD_KEY_STATE_PRESSED){
+        // If alt is held down and this button was _pressed_, we attempt to processes it as a compositor keybinding
+        for (int i = 0; i < nsyms; i++){
+            handled = handle_keybindings(server,syms[i]);
+        }
+    }
+
+    if (!handled){
+        // Otherwise, pass it along to client
+        int64_t notify_start_ns = trace_begin();
+        wlr_seat_set_keyboard(seat, keyboard->wlr_keyboard);
+        wlr_seat_keyboard_notify_key(seat, event->time_msec, event->keycode, event->state);
+        trace_end(PWC_TRACE_INPUT, "seat notify", notify_start_ns, NULL);
+    }
+    trace_end(PWC_TRACE_INPUT, "key", trace_start_ns, handled ? "keybinding" : NULL);
+}
+
+static void keyboard_handle_destroy(struct wl_listener *listener, void *data){
+    // This event is raised by the keyboard base wlr_input_device to signal destruction of wlr_keyboard. AKA the keyboard got disconnected
+    struct pwc_keyboard *keyboard = wl_container_of(listener, keyboard, destroy);
+    wl_list_remove(&keyboard->modifiers.link);
+    wl_list_remove(&keyboard->key.link);
+    wl_list_remove(&keyboard->destroy.link);
+    wl_list_remove(&keyboard->link);
+    free(keyboard);
+}
+
+static void server_new_keyboard(struct pwc_server *server, struct wlr_input_device *device){
+    struct wlr_keyboard *wlr_keyboard = wlr_keyboard_from_input_device(device);
+    struct pwc_keyboard *keyboard = calloc(1, sizeof(*keyboard));
+    keyboard->server = server;
+    keyboard->wlr_keyboard = wlr_keyboard;
+
+    // Assigning an XKB keymap to the keyboard. Assumes defaults (US), compiled once and shared by all keyboards
+    struct xkb_keymap *keymap = keymap_cache_get(server, NULL);
+    if (keymap != NULL) wlr_keyboard_set_keymap(wlr_keyboard, keymap);
+    wlr_keyboard_set_repeat_info(wlr_keyboard, 25, 600);
+
+    // Set up listeners for keyboard events
+    keyboard->modifiers.notify = keyboard_handle_modifiers;
+    wl_signal_add(&wlr_keyboard->events.modifiers, &keyboard->modifiers);
+    keyboard->key.notify = keyboard_handle_key;
+    wl_signal_add(&wlr_keyboard->events.key, &keyboard->key);
+    keyboard->destroy.notify = keyboard_handle_destroy;
+    wl_signal_add(&device->events.destroy, &keyboard->destroy);
+
+    wlr_seat_set_keyboard(server->seat, keyboard->wlr_keyboard);
+
+    // Add keyboard to list
+    wl_list_insert(&server->keyboards, &keyboard->link);
+}
+
+static void server_new_pointer(struct pwc_server *server, struct wlr_input_device *device){
+    // Don't do anything special with pointers, all is handled in wlr_cursor. Could use to  do libinput config, acceleration etc
+    wlr_cursor_attach_input_device(server->cursor, device);
+
+}
+
+void server_new_input(struct wl_listener *listener, void *data){
+    // Event raised by backend when new input device is available
+    struct pwc_server *server = wl_container_of(listener, server, new_input);
+    struct wlr_input_device *device = data;
+    switch (device->type){
+        case WLR_INPUT_DEVICE_KEYBOARD:
+            server_new_keyboard(server,device);
+            break;
+        case WLR_INPUT_DEVICE_POINTER:
+            server_new_pointer(server, device);
+            break;
+        case WLR_INPUT_DEVICE_TABLET:
+            server_new_tablet(server, device);
+            break;
+        case WLR_INPUT_DEVICE_TABLET_PAD:
+            server_new_tablet_pad(server, device);
+            break;
+        default: break;
+    }
+
+    // Let wlr_seat know what capabilities are, which is communicated to the client. Cursor is always there no matter what
+    uint32_t caps = WL_SEAT_CAPABILITY_POINTER;
+    if (!wl_list_empty(&server->keyboards)) caps |= WL_SEAT_CAPABILITY_KEYBOARD;
+    wlr_seat_set_capabilities(server->seat, caps);
+}
+
+void cursor_set_xcursor(struct pwc_server *server, const char *name){
+    // Shows a cursor from the theme. The xcursor manager keeps one decoded copy of the theme per scale for all..
+    // outputs, and setting the image already shown is a no-op, so motion over empty space doesn't redo the lookup..
+    // and cursor plane update on every event. name has to outlive the cursor image (literals, shape names)
+    if (server->cursor_xcursor != NULL && strcmp(server->cursor_xcursor, name) == 0){
+        server->cursor_sets_skipped++;
+        return;
+    }
+    server->cursor_xcursor = name;
+    server->cursor_image_changes++;
+    wlr_cursor_set_xcursor(server->cursor, server->cursor_mgr, name);
+}
+
+void seat_request_cursor(struct wl_listener *listener, void *data){
+    struct pwc_server *server = wl_container_of(listener, server, request_cursor);
+    // Event is rasied by the seat when a client provides a cursor image
+    struct wlr_seat_pointer_request_set_cursor_event *event = data;
+    struct wlr_seat_client *focused_client = server->seat->pointer_state.focused_client;
+    // This can be sent by any client, make sure this one has pointer focus first
+    if (focused_client == event->seat_client){
+        server->cursor_xcursor = NULL;
+        server->cursor_image_changes++;
+        wlr_cursor_set_surface(server -> cursor, event->surface, event->hotspot_x, event->hotspot_y);
+    }
+}
+
+void seat_request_set_shape(struct wl_listener *listener, void *data){
+    // Event is raised when a client names a cursor shape instead of drawing its own cursor surface
+    struct pwc_server *server = wl_container_of(listener, server, request_set_shape);
+    struct wlr_cursor_shape_manager_v1_request_set_shape_event *event = data;
+    // Pointer and tablet tools share the one cursor. Only the client with pointer focus, or the one owning the..
+    // surface the tool is over (see tablet.c), may pick its shape
+    if (event->device_type == WLR_CURSOR_SHAPE_MANAGER_V1_DEVICE_TYPE_TABLET_TOOL){
+        struct wlr_surface *focused = event->tablet_tool != NULL ? event->tablet_tool->focused_surface : NULL;
+        if (focused == NULL || wl_resource_get_client(focused->resource) != event->seat_client->client) return;
+    }
+    else if (event->seat_client != server->seat->pointer_state.focused_client) return;
+    cursor_set_xcursor(server, wlr_cursor_shape_v1_name(event->shape));
+}
+
+void seat_pointer_focus_change(struct wl_listener *listener, void *data){
+    struct pwc_server *server = wl_container_of(listener, server, pointer_focus_change);
+    // This event is raised when pointer focus is changed, including closure of the client
+    // Cursor image set to default if target surface is NULL
+    struct wlr_seat_pointer_focus_change_event *event = data;
+    if (event->new_surface == NULL){
+        cursor_set_xcursor(server, "default");
+    }
+}
+
+void seat_request_set_selection(struct wl_listener *listener, void *data) {
+    // Event raised by seat when client wants to set the selection, usually when user copies something ( OPTIONAL )
+    struct pwc_server *server = wl_container_of(listener, server, request_set_selection);
+    struct wlr_seat_request_set_selection_event *event = data;
+    wlr_seat_set_selection(server->seat, event->source, event->serial);
+}
+
+static void pointer_constraint_deactivate(struct pwc_server *server, bool send){
+    // Releases the active constraint. A lock can leave a hint of where the cursor should be on release
+    struct wlr_pointer_constraint_v1 *constraint = server->active_constraint;
+    if (constraint == NULL) return;
+    server->active_constraint = NULL;
+    if (constraint->type == WLR_POINTER_CONSTRAINT_V1_LOCKED && constraint->current.cursor_hint.enabled &&
+            server->seat->pointer_state.focused_surface == constraint->surface){
+        double x = server->constraint_x + constraint->current.cursor_hint.x;
+        double y = server->constraint_y + constraint->current.cursor_hint.y;
+        wlr_cursor_warp(server->cursor, NULL, x, y);
+        wlr_seat_pointer_warp(server->seat, x - server->constraint_x, y - server->constraint_y);
+    }
+    if (send) wlr_pointer_constraint_v1_send_deactivated(constraint);
+}
+
+static void pointer_constraint_update(struct pwc_server *server, struct wlr_surface *surface, double sx, double sy){
+    // Activates the constraint of the surface under the pointer, and releases the active one once that surface..
+    // loses pointer or keyboard focus. sx, sy is where the pointer is on the surface
+    struct wlr_pointer_constraint_v1 *constraint = NULL;
+    struct wlr_surface *keyboard_surface = server->seat->keyboard_state.focused_surface;
+    if (surface != NULL && keyboard_surface != NULL &&
+            wlr_surface_get_root_surface(surface) == wlr_surface_get_root_surface(keyboard_surface)){
+        constraint = wlr_pointer_constraints_v1_constraint_for_surface(server->pointer_constraints, surface, server->seat);
+    }
+    // Confinement starts once the pointer is inside the region, an active one keeps it there
+    if (constraint != NULL && constraint != server->active_constraint && constraint->type == WLR_POINTER_CONSTRAINT_V1_CONFINED &&
+            !pixman_region32_contains_point(&constraint->region, floor(sx), floor(sy), NULL)){
+        constraint = NULL;
+    }
+    if (constraint != server->active_constraint) pointer_constraint_deactivate(server, true);
+    // The window may have moved since activation
+    server->constraint_x = server->cursor->x - sx;
+    server->constraint_y = server->cursor->y - sy;
+    if (constraint == NULL || constraint == server->active_constraint) return;
+    server->active_constraint = constraint;
+    wlr_pointer_constraint_v1_send_activated(constraint);
+}
+
+static void pointer_constraint_set_region(struct wl_listener *listener, void *data){
+    // A confined pointer outside the new region is put back on its nearest edge on the next motion event
+    struct pwc_pointer_constraint *constraint = wl_container_of(listener, constraint, set_region);
+    struct pwc_server *server = constraint->server;
+    if (server->active_constraint != constraint->wlr_constraint) return;
+    if (constraint->wlr_constraint->type != WLR_POINTER_CONSTRAINT_V1_CONFINED) return;
+    double sx = server->cursor->x - server->constraint_x;
+    double sy = server->cursor->y - server->constraint_y;
+    if (pixman_region32_contains_point(&constraint->wlr_constraint->region, floor(sx), floor(sy), NULL)) return;
+    pointer_constraint_deactivate(server, true);
+}
+
+static void pointer_constraint_destroy(struct wl_listener *listener, void *data){
+    struct pwc_pointer_constraint *constraint = wl_container_of(listener, constraint, destroy);
+    // The client is gone or destroyed the object, there is no one left to tell
+    if (constraint->server->active_constraint == constraint->wlr_constraint) pointer_constraint_deactivate(constraint->server, false);
+    wl_list_remove(&constraint->set_region.link);
+    wl_list_remove(&constraint->destroy.link);
+    free(constraint);
+}
+
+void server_new_pointer_constraint(struct wl_listener *listener, void *data){
+    // Raised when a client asks to lock or confine the pointer to one of its surfaces
+    struct pwc_server *server = wl_container_of(listener, server, new_pointer_constraint);
+    struct wlr_pointer_constraint_v1 *wlr_constraint = data;
+    struct pwc_pointer_constraint *constraint = calloc(1, sizeof(*constraint));
+    if (constraint == NULL) return;
+    constraint->server = server;
+    constraint->wlr_constraint = wlr_constraint;
+    constraint->set_region.notify = pointer_constraint_set_region;
+    wl_signal_add(&wlr_constraint->events.set_region, &constraint->set_region);
+    constraint->destroy.notify = pointer_constraint_destroy;
+    wl_signal_add(&wlr_constraint->events.destroy, &constraint->destroy);
+    // Games usually ask while the pointer is already over them
+    struct wlr_seat_pointer_state *pointer_state = &server->seat->pointer_state;
+    if (pointer_state->focused_surface == wlr_constraint->surface){
+        server_flush_motion(server);
+        pointer_constraint_update(server, pointer_state->focused_surface, pointer_state->sx, pointer_state->sy);
+    }
+}
+
+void seat_keyboard_focus_change(struct wl_listener *listener, void *data){
+    // Tablet pads follow keyboard focus. Constraints only hold while their surface has keyboard focus, so switching..
+    // windows from the keyboard always gets the pointer back
+    struct pwc_server *server = wl_container_of(listener, server, keyboard_focus_change);
+    struct wlr_seat_keyboard_focus_change_event *event = data;
+    tablet_pads_focus(server, event->new_surface);
+    struct wlr_seat_pointer_state *pointer_state = &server->seat->pointer_state;
+    if (server->active_constraint == NULL && pointer_state->focused_surface == NULL) return;
+    pointer_constraint_update(server, pointer_state->focused_surface, pointer_state->sx, pointer_state->sy);
+}
+
+void reset_cursor_mode(struct pwc_server *server){
+    // Reset the cursor mode to passthrough
+    server->cursor_mode = PWC_CURSOR_PASSTHROUGH;
+    server->grabbed_toplevel = NULL;
+}
+
+static void process_cursor_mode(struct pwc_server *server){
+    // Move the grabbed toplevel to new_position
+    struct pwc_toplevel *toplevel = server->grabbed_toplevel;
+    toplevel_set_position(toplevel, server->cursor->x - server->grab_x, server->cursor->y - server->grab_y);
+    hit_index_update(server, toplevel);
+}
+
+static void process_cursor_resize(struct pwc_server *server){
+    // Resizing the grabbed toplevel can be complicated because the user can resize from any corner or resize_edges
+    // This only asks for the new geometry, the toplevel is moved once the client commits a buffer at the new size
+    struct pwc_toplevel *toplevel = server->grabbed_toplevel;
+    double border_x = server->cursor->x - server->grab_x;
+    double border_y = server->cursor->y - server->grab_y;
+    int new_left = server->grab_geobox.x;
+    int new_right = server->grab_geobox.x + server->grab_geobox.width;
+    int new_top = server->grab_geobox.y;
+    int new_bottom = server->grab_geobox.y + server->grab_geobox.height;
+
+    if (server->resize_edges & WLR_EDGE_TOP){
+        new_top = border_y;
+        if (new_top >= new_bottom) new_top = new_bottom - 1;
+    }
+    else if (server->resize_edges & WLR_EDGE_BOTTOM){
+        new_bottom = border_y;
+        if (new_bottom <= new_top) new_bottom = new_top + 1;
+    }
+
+    if (server->resize_edges & WLR_EDGE_LEFT){
+        new_left = border_x;
+        if (new_left >= new_right) new_left = new_right - 1;
+    }
+    else if (server->resize_edges & WLR_EDGE_RIGHT){
+        new_right = border_x;
+        if (new_right <= new_left) new_right = new_left + 1;
+    }
+
+    struct wlr_box box = { new_left, new_top, new_right - new_left, new_bottom - new_top };
+    toplevel_resize(toplevel, &box, server->resize_edges);
+}
+
+bool cursor_grab_motion(struct pwc_server *server){
+    // If the mode is non-passthrough, delegate to those functions. false when there is no interactive move or resize
+    if (server->cursor_mode == PWC_CURSOR_MOVE){process_cursor_mode(server); return true;}
+    else if (server->cursor_mode == PWC_CURSOR_RESIZE){process_cursor_resize(server); return true;}
+    return false;
+}
+
+void cursor_pointer_focus(struct pwc_server *server, uint32_t time, struct wlr_surface *surface, double sx, double sy){
+    // Gives pointer focus to the surface a hit test found under the cursor, sx, sy being the cursor on it
+    struct wlr_seat *seat = server->seat;
+    // If there is no surface under the cursor (empty space, or a fullscreen backdrop), set cursor image to default
+    if (!surface) cursor_set_xcursor(server, "default");
+
+    if (surface){
+        // Send pointer enter and motion events.
+        // The enter event gives the surface "Pointer Focus", which is distinct from keyboard focus
+        // wlroots will avoid sending duplicate enter/motion events if surface already had pointer focus or client is aware of the coordinates passed
+        int64_t trace_start_ns = trace_begin();
+        wlr_seat_pointer_notify_enter(seat, surface, sx, sy);
+        wlr_seat_pointer_notify_motion(seat, time, sx, sy);
+        trace_end(PWC_TRACE_INPUT, "seat notify", trace_start_ns, NULL);
+    }
+    else{
+        // Clear pointer focus so future button events and such are not sent to the last client
+        wlr_seat_pointer_clear_focus(seat);
+    }
+    pointer_constraint_update(server, surface, sx, sy);
+}
+
+static void process_cursor_motion(struct pwc_server *server, uint32_t time){
+    if (cursor_grab_motion(server)) return;
+
+    // Otherwise, find the toplevel under the pointer and send the event along
+    double sx = 0, sy = 0;
+    struct wlr_surface *surface = NULL;
+    int64_t trace_start_ns = trace_begin();
+    desktop_toplevel_at(server, server->cursor->x, server->cursor->y, &surface, &sx, &sy);
+    trace_end(PWC_TRACE_INPUT, "hit test", trace_start_ns, NULL);
+    cursor_pointer_focus(server, time, surface, sx, sy);
+}
+
+static void constrained_cursor_motion(struct pwc_server *server, struct wlr_input_device *device, double dx, double dy, uint32_t time_msec){
+    // The pointer can't leave the constrained surface, so there is nothing to hit-test. A locked pointer stays put..
+    // and the client only sees the relative events, a confined one is kept inside the region
+    struct wlr_pointer_constraint_v1 *constraint = server->active_constraint;
+    server->motion_events++;
+    server->motion_constrained++;
+    trace_instant(PWC_TRACE_INPUT, "pointer motion", constraint->type == WLR_POINTER_CONSTRAINT_V1_LOCKED ? "locked" : "confined");
+    if (constraint->type == WLR_POINTER_CONSTRAINT_V1_LOCKED) return;
+    double sx = server->cursor->x - server->constraint_x;
+    double sy = server->cursor->y - server->constraint_y;
+    double confined_x, confined_y;
+    if (!wlr_region_confine(&constraint->region, sx, sy, sx + dx, sy + dy, &confined_x, &confined_y)) return;
+    wlr_cursor_move(server->cursor, device, confined_x - sx, confined_y - sy);
+    wlr_seat_pointer_notify_motion(server->seat, time_msec, server->cursor->x - server->constraint_x, server->cursor->y - server->constraint_y);
+}
+
+void cursor_rebase(struct pwc_server *server){
+    // Re-evaluates pointer focus after the scene changed under a cursor that didn't move. This is also what..
+    // releases a constraint when its window goes away or something maps on top of it. There is no device frame..
+    // to close the enter/motion/leave it sends, so it sends its own
+    if (server->cursor_mode != PWC_CURSOR_PASSTHROUGH) return;
+    process_cursor_motion(server, (uint32_t)(get_time_ns() / 1000000));
+    wlr_seat_pointer_notify_frame(server->seat);
+}
+
+static void handle_motion_idle(void *data){
+    struct pwc_server *server = data;
+    server->motion_idle = NULL;
+    server_flush_motion(server);
+}
+
+void server_flush_motion(struct pwc_server *server){
+    // Applies coalesced pointer motion. Anything that depends on where the pointer is, or on the order of pointer..
+    // events (buttons, axis, focus changes), has to flush first
+    if (server->motion_idle != NULL){
+        wl_event_source_remove(server->motion_idle);
+        server->motion_idle = NULL;
+    }
+    if (server->motion_pending){
+        server->motion_pending = false;
+        process_cursor_motion(server, server->motion_time_msec);
+    }
+    if (server->motion_frame_pending){
+        server->motion_frame_pending = false;
+        wlr_seat_pointer_notify_frame(server->seat);
+    }
+}
+
+static void queue_cursor_motion(struct pwc_server *server, uint32_t time_msec){
+    server->motion_events++;
+    trace_instant(PWC_TRACE_INPUT, "pointer motion", server->coalesce_motion ? "queued" : NULL);
+    if (!server->coalesce_motion){
+        process_cursor_motion(server, time_msec);
+        return;
+    }
+    if (server->motion_pending) server->motion_coalesced++;
+    server->motion_pending = true;
+    server->motion_time_msec = time_msec;
+    // Idle sources run once the event loop has dispatched everything that was ready, i.e. after the backend..
+    // has read the whole batch of queued input events
+    if (server->motion_idle == NULL){
+        server->motion_idle = wl_event_loop_add_idle(wl_display_get_event_loop(server->wl_display), handle_motion_idle, server);
+    }
+}
+
+void server_cursor_motion(struct wl_listener *listener, void *data){
+    // Event is forwarded by the cursor when a pointer emits a _relative_ pointer motion event (i.e. delta)
+    struct pwc_server *server = wl_container_of(listener, server, cursor_motion);
+    struct wlr_pointer_motion_event *event = data;
+    // Relative pointer clients get every delta, even when the motion itself is coalesced or the pointer is locked
+    wlr_relative_pointer_manager_v1_send_relative_motion(server->relative_pointer_manager, server->seat,
+            (uint64_t)event->time_msec * 1000, event->delta_x, event->delta_y, event->unaccel_dx, event->unaccel_dy);
+    if (server->active_constraint != NULL && server->cursor_mode == PWC_CURSOR_PASSTHROUGH){
+        constrained_cursor_motion(server, &event->pointer->base, event->delta_x, event->delta_y, event->time_msec);
+        return;
+    }
+    // The cursor does not move unless we tell it to.
+    // The cursor automatically handles constraining the motion to the output layout, as well as any special config applied.
+    wlr_cursor_move(server->cursor, &event->pointer->base, event->delta_x, event->delta_y);
+    queue_cursor_motion(server, event->time_msec);
+}
+
+void server_cursor_motion_absolute(struct wl_listener *listener, void *data){
+    // Event is forwarded by the cursor when a pointer emits a _absolute_ pointer motion event from 0..1 on each axis.
+    // This happens, for example, when wlroots is running under a wayland window rather than KMS+DRM and the mouse is moved over...
+    // the window. The mouse can etner from any edge so it has to be warped there.
+    struct pwc_server *server = wl_container_of(listener, server, cursor_motion_absolute);
+    struct wlr_pointer_motion_absolute_event *event = data;
+    double lx, ly;
+    wlr_cursor_absolute_to_layout_coords(server->cursor, &event->pointer->base, event->x, event->y, &lx, &ly);
+    double dx = lx - server->cursor->x;
+    double dy = ly - server->cursor->y;
+    wlr_relative_pointer_manager_v1_send_relative_motion(server->relative_pointer_manager, server->seat,
+            (uint64_t)event->time_msec * 1000, dx, dy, dx, dy);
+    if (server->active_constraint != NULL && server->cursor_mode == PWC_CURSOR_PASSTHROUGH){
+        constrained_cursor_motion(server, &event->pointer->base, dx, dy, event->time_msec);
+        return;
+    }
+    wlr_cursor_warp_absolute(server->cursor, &event->pointer->base, event->x, event->y);
+    queue_cursor_motion(server, event->time_msec);
+}
+
+void cursor_button(struct pwc_server *server, uint32_t time_msec, uint32_t button, uint32_t state){
+    // Button handling shared by pointers and tablet tools emulating one. Focusing on press is up to the caller
+    // The button goes to whatever is under the pointer now, not where it was a batch ago
+    server_flush_motion(server);
+    // Notify client with pointer focus that a button press has occured
+    wlr_seat_pointer_notify_button(server->seat, time_msec, button, state);
+    // If you released any button, we exit interactive move/resize mode
+    if (state == WL_POINTER_BUTTON_STATE_RELEASED) reset_cursor_mode(server);
+}
+
+void server_cursor_button(struct wl_listener *listener, void *data){
+    // This event is forwarded by the cursor when a pointer emits a button event
+    struct pwc_server *server = wl_container_of(listener, server, cursor_button);
+    struct wlr_pointer_button_event *event = data;
+    trace_instant(PWC_TRACE_INPUT, "button", NULL);
+    cursor_button(server, event->time_msec, event->button, event->state);
+    if (event->state == WL_POINTER_BUTTON_STATE_PRESSED){
+        // Focus that client if the button was _pressed_
+        double sx, sy;
+        struct wlr_surface *surface = NULL;
+        struct pwc_toplevel *toplevel = desktop_toplevel_at(server, server->cursor->x, server->cursor->y, &surface, &sx,  &sy);
+        focus_toplevel(toplevel);
+    }
+}
+
+void server_cursor_axis(struct wl_listener *listener, void *data){
+    // This event is forwarded by the cursor when a pointer emits an axis event (i.e. moving scroll wheel)
+    struct pwc_server *server = wl_container_of(listener, server, cursor_axis);
+    struct wlr_pointer_axis_event *event = data;
+    server_flush_motion(server);
+    // Notify the client with pointer focus of the axis event
+    wlr_seat_pointer_notify_axis(server->seat, event->time_msec, event->orientation, event->delta,
+                                 event->delta_discrete, event->source, event->relative_direction);
+}
+
+void server_cursor_frame(struct wl_listener *listener, void *data){
+    // Event is forwarded by the cursor when a pointer emits a frame event.
+    // Frame events are sent after regular pointer events to group multiple events together.
+    struct pwc_server *server = wl_container_of(listener, server, cursor_frame);
+    // A frame closing coalesced motion has to follow the motion events, send it when they are flushed
+    if (server->motion_pending){
+        server->motion_frame_pending = true;
+        return;
+    }
+    wlr_seat_pointer_notify_frame(server->seat);
+}
@@ -0,0 +1,215 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+#include <xkbcommon/xkbcommon.h>
+#include "server.h"
+
+// Keymaps are compiled once per RMLVO and shared by every keyboard using it, so hotplugging a keyboard (or a device..
+// exposing several keyboard interfaces) doesn't pay for a compile. With a disk cache the compiled keymap is also..
+// written out in its fully resolved text form, which loads much faster than resolving RMLVO through the include path.
+//
+// A cache file is only used while the XKB data it was resolved from looks unchanged: its header records the newest..
+// modification time among every include path, its rules file and its component directories. Upgrades replace..
+// files, which touches those directories. Editing an existing file in place (say ~/.config/xkb/symbols/custom) does..
+// not, remove $XDG_CACHE_HOME/pwc/keymap-*.xkb after that.
+
+struct pwc_keymap {
+    struct wl_list link;
+    char *rmlvo;
+    struct xkb_keymap *keymap;
+};
+
+static const char *name_or_env(const char *name, const char *env){
+    // Mirrors xkbcommon: unset names fall back to XKB_DEFAULT_*, then to the built-in defaults (kept as "")
+    if (name != NULL && name[0] != '\0') return name;
+    const char *value = getenv(env);
+    return value != NULL ? value : "";
+}
+
+static char *rmlvo_key(const struct xkb_rule_names *names){
+    struct xkb_rule_names empty = {0};
+    if (names == NULL) names = &empty;
+    const char *rules = name_or_env(names->rules, "XKB_DEFAULT_RULES");
+    const char *model = name_or_env(names->model, "XKB_DEFAULT_MODEL");
+    const char *layout = name_or_env(names->layout, "XKB_DEFAULT_LAYOUT");
+    const char *variant = name_or_env(names->variant, "XKB_DEFAULT_VARIANT");
+    const char *options = name_or_env(names->options, "XKB_DEFAULT_OPTIONS");
+
+    size_t len = strlen(rules) + strlen(model) + strlen(layout) + strlen(variant) + strlen(options) + 5;
+    char *key = malloc(len);
+    if (key == NULL) return NULL;
+    snprintf(key, len, "%s:%s:%s:%s:%s", rules, model, layout, variant, options);
+    return key;
+}
+
+static char *cache_path(const char *key){
+    // $XDG_CACHE_HOME/pwc/keymap-<hash of RMLVO>.xkb, creating the directory on the way
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[4096];
+    if (base != NULL && base[0] != '\0') snprintf(dir, sizeof(dir), "%s", base);
+    else if (home != NULL) snprintf(dir, sizeof(dir), "%s/.cache", home);
+    else return NULL;
+    mkdir(dir, 0755);
+    strncat(dir, "/pwc", sizeof(dir) - strlen(dir) - 1);
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return NULL;
+
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (const char *c = key; *c != '\0'; c++) hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+
+    size_t len = strlen(dir) + 32;
+    char *path = malloc(len);
+    if (path == NULL) return NULL;
+    snprintf(path, len, "%s/keymap-%016" PRIx64 ".xkb", dir, hash);
+    return path;
+}
+
+static void stamp_update(int64_t *stamp, const char *dir, const char *name){
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    struct stat st;
+    if (stat(path, &st) != 0) return;
+    int64_t mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    if (mtime > *stamp) *stamp = mtime;
+}
+
+static char *cache_header(struct pwc_server *server, const char *key){
+    // RMLVO plus the newest modification time of the XKB data it resolves through, see the top of the file
+    static const char *const components[] = { ".", "keycodes", "types", "compat", "symbols" };
+    char rules[256] = "rules/";
+    size_t rules_len = strcspn(key, ":");
+    // Empty rules means xkbcommon's built-in default
+    if (rules_len == 0) strncat(rules, "evdev", sizeof(rules) - strlen(rules) - 1);
+    else strncat(rules, key, rules_len < sizeof(rules) - 7 ? rules_len : sizeof(rules) - 7);
+    int64_t stamp = 0;
+    for (unsigned int i = 0; i < xkb_context_num_include_paths(server->xkb_context); i++){
+        const char *dir = xkb_context_include_path_get(server->xkb_context, i);
+        for (size_t j = 0; j < sizeof(components) / sizeof(components[0]); j++) stamp_update(&stamp, dir, components[j]);
+        stamp_update(&stamp, dir, rules);
+    }
+    size_t len = strlen(key) + 24;
+    char *header = malloc(len);
+    if (header == NULL) return NULL;
+    snprintf(header, len, "%s %" PRId64, key, stamp);
+    return header;
+}
+
+static struct xkb_keymap *keymap_load(struct pwc_server *server, const char *path, const char *header){
+    // The first line records the RMLVO the keymap was compiled from and the XKB data stamp, anything else is a stale..
+    // or colliding file
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return NULL;
+    char *data = NULL;
+    size_t size = 0;
+    struct xkb_keymap *keymap = NULL;
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0 &&
+            (data = malloc(size + 1)) != NULL && fread(data, 1, size, file) == size){
+        data[size] = '\0';
+        char *newline = strchr(data, '\n');
+        if (newline != NULL && strncmp(data, "// ", 3) == 0 && (size_t)(newline - data - 3) == strlen(header) &&
+                strncmp(data + 3, header, strlen(header)) == 0){
+            keymap = xkb_keymap_new_from_string(server->xkb_context, newline + 1, XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+        }
+    }
+    free(data);
+    fclose(file);
+    return keymap;
+}
+
+static void keymap_save(struct xkb_keymap *keymap, const char *path, const char *header){
+    // Written to a temporary file then renamed, so a concurrent start never reads half a keymap
+    char *text = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    if (text == NULL) return;
+    size_t len = strlen(path) + 5;
+    char *tmp = malloc(len);
+    if (tmp != NULL){
+        snprintf(tmp, len, "%s.tmp", path);
+        FILE *file = fopen(tmp, "w");
+        if (file != NULL){
+            bool ok = fprintf(file, "// %s\n%s", header, text) > 0;
+            ok = fclose(file) == 0 && ok;
+            if (!ok || rename(tmp, path) != 0){
+                wlr_log(WLR_ERROR, "failed to write keymap cache %s", path);
+                remove(tmp);
+            }
+        }
+        free(tmp);
+    }
+    free(text);
+}
+
+bool keymap_cache_init(struct pwc_server *server){
+    wl_list_init(&server->keymaps);
+    server->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    if (server->xkb_context == NULL){
+        wlr_log(WLR_ERROR, "failed to create xkb_context");
+        return false;
+    }
+    return true;
+}
+
+void keymap_cache_finish(struct pwc_server *server){
+    struct pwc_keymap *entry, *tmp;
+    wl_list_for_each_safe(entry, tmp, &server->keymaps, link){
+        wl_list_remove(&entry->link);
+        xkb_keymap_unref(entry->keymap);
+        free(entry->rmlvo);
+        free(entry);
+    }
+    xkb_context_unref(server->xkb_context);
+    server->xkb_context = NULL;
+}
+
+struct xkb_keymap *keymap_cache_get(struct pwc_server *server, const struct xkb_rule_names *names){
+    // Returns a keymap for the given RMLVO names (NULL for defaults). The cache keeps its own reference, callers..
+    // don't unref the result
+    char *key = rmlvo_key(names);
+    if (key == NULL) return NULL;
+    struct pwc_keymap *entry;
+    wl_list_for_each(entry, &server->keymaps, link){
+        if (strcmp(entry->rmlvo, key) == 0){
+            server->keymap_cache_hits++;
+            free(key);
+            return entry->keymap;
+        }
+    }
+
+    int64_t start = get_time_ns();
+    char *path = server->keymap_disk_cache ? cache_path(key) : NULL;
+    char *header = path != NULL ? cache_header(server, key) : NULL;
+    struct xkb_keymap *keymap = header != NULL ? keymap_load(server, path, header) : NULL;
+    bool from_disk = keymap != NULL;
+    if (keymap == NULL) keymap = xkb_keymap_new_from_names(server->xkb_context, names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    int64_t elapsed = get_time_ns() - start;
+
+    if (keymap == NULL){
+        wlr_log(WLR_ERROR, "failed to compile keymap for %s", key);
+        free(header);
+        free(path);
+        free(key);
+        return NULL;
+    }
+    server->keymap_compiles++;
+    server->keymap_compile_ns += elapsed;
+    wlr_log(WLR_INFO, "Keymap %s %s in %.3f ms", key, from_disk ? "loaded from disk cache" : "compiled", elapsed / 1e6);
+    if (header != NULL && !from_disk) keymap_save(keymap, path, header);
+    free(header);
+    free(path);
+
+    entry = calloc(1, sizeof(*entry));
+    if (entry == NULL){
+        xkb_keymap_unref(keymap);
+        free(key);
+        return NULL;
+    }
+    entry->rmlvo = key;
+    entry->keymap = keymap;
+    wl_list_insert(&server->keymaps, &entry->link);
+    return keymap;
+}
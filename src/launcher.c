@@ -0,0 +1,80 @@
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+#include "server.h"
+
+// Runs commands without blocking the event loop. posix_spawn() returns as soon as the child has exec'd the shell,..
+// and children are reaped from SIGCHLD through the event loop's signalfd, so nothing is left as a zombie.
+
+extern char **environ;
+
+static int handle_sigchld(int signal_number, void *data){
+    // One SIGCHLD can stand for several exited children, reap everything that is ready
+    pid_t pid;
+    int status;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0){
+        if (WIFEXITED(status)) wlr_log(WLR_DEBUG, "Child %d exited with status %d", (int)pid, WEXITSTATUS(status));
+        else if (WIFSIGNALED(status)) wlr_log(WLR_DEBUG, "Child %d killed by signal %d", (int)pid, WTERMSIG(status));
+    }
+    return 0;
+}
+
+bool launcher_init(struct pwc_server *server){
+    // wl_event_loop_add_signal() blocks SIGCHLD and reads it from a signalfd. Children get an empty mask back in launcher_spawn()
+    server->sigchld_source = wl_event_loop_add_signal(wl_display_get_event_loop(server->wl_display), SIGCHLD, handle_sigchld, server);
+    if (server->sigchld_source == NULL){
+        wlr_log(WLR_ERROR, "failed to watch SIGCHLD");
+        return false;
+    }
+    return true;
+}
+
+void launcher_finish(struct pwc_server *server){
+    // Children keep running, they are only no longer reaped by us
+    if (server->sigchld_source != NULL) wl_event_source_remove(server->sigchld_source);
+    server->sigchld_source = NULL;
+}
+
+pid_t launcher_spawn(struct pwc_server *server, const char *command){
+    // Spawns `/bin/sh -c command` and returns its pid, or -1 on failure
+    int64_t start = get_time_ns();
+
+    // The event loop blocks the signals it handles, don't pass that on. The child also gets its own process group..
+    // so signals aimed at the compositor's group don't take it down.
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGCHLD);
+    sigaddset(&defaults, SIGUSR1);
+    sigaddset(&defaults, SIGUSR2);
+    sigaddset(&defaults, SIGHUP);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+
+    pid_t pid;
+    char *argv[] = { "/bin/sh", "-c", (char *)command, NULL };
+    int err = posix_spawn(&pid, "/bin/sh", NULL, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+
+    // Time the event loop was held up. With the vfork-style posix_spawn() this is also how long it took the child to exec
+    int64_t elapsed = get_time_ns() - start;
+    server->spawns++;
+    server->spawn_time_ns += elapsed;
+    if (elapsed > server->spawn_time_max_ns) server->spawn_time_max_ns = elapsed;
+
+    if (err != 0){
+        wlr_log(WLR_ERROR, "failed to spawn '%s': %s", command, strerror(err));
+        return -1;
+    }
+    wlr_log(WLR_DEBUG, "Spawned '%s' as %d in %.3f ms", command, (int)pid, elapsed / 1e6);
+    return pid;
+}
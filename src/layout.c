@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/edges.h>
+#include <wlr/util/log.h>
+#include "server.h"
+
+// Tiling layout with atomic transactions. Rearranging a workspace configures every window at once, and each window..
+// whose size changes is frozen on a snapshot of its current buffers until it commits at the new size. Once the..
+// last one has committed, or the timeout fired, the snapshots go away and every window moves in the same event loop..
+// iteration, so the next output commit shows the whole new layout and nothing in between.
+//
+// The layout is master and stack: the oldest window takes the left half, the others share the right half top to bottom.
+
+static void snapshot_iter(struct wlr_scene_buffer *buffer, int sx, int sy, void *data){
+    // Copies a buffer node into the snapshot tree. The copy holds its own lock on the client buffer
+    struct wlr_scene_tree *snapshot = data;
+    if (buffer->buffer == NULL) return;
+    struct wlr_scene_buffer *copy = wlr_scene_buffer_create(snapshot, buffer->buffer);
+    if (copy == NULL) return;
+    wlr_scene_node_set_position(&copy->node, sx, sy);
+    wlr_scene_buffer_set_dest_size(copy, buffer->dst_width, buffer->dst_height);
+    wlr_scene_buffer_set_source_box(copy, &buffer->src_box);
+    wlr_scene_buffer_set_transform(copy, buffer->transform);
+}
+
+static void toplevel_snapshot(struct pwc_toplevel *toplevel){
+    // Shows what the window looks like now in place of the live surfaces, which are hidden until the transaction applies
+    struct wlr_scene_node *node = &toplevel->scene_tree->node;
+    toplevel->tile.snapshot = wlr_scene_tree_create(node->parent);
+    if (toplevel->tile.snapshot == NULL) return;
+    wlr_scene_node_for_each_buffer(node, snapshot_iter, toplevel->tile.snapshot);
+    wlr_scene_node_place_above(&toplevel->tile.snapshot->node, node);
+    wlr_scene_node_set_enabled(node, false);
+}
+
+static void toplevel_drop_snapshot(struct pwc_toplevel *toplevel){
+    if (toplevel->tile.snapshot == NULL) return;
+    wlr_scene_node_destroy(&toplevel->tile.snapshot->node);
+    toplevel->tile.snapshot = NULL;
+    wlr_scene_node_set_enabled(&toplevel->scene_tree->node, true);
+}
+
+static void transaction_apply(struct pwc_server *server, bool timed_out){
+    // Moves every window of the transaction into place, all before the next frame
+    wl_event_source_timer_update(server->transaction_timer, 0);
+    struct pwc_toplevel *toplevel;
+    wl_list_for_each(toplevel, &server->toplevels, link){
+        if (!toplevel->tile.in_transaction) continue;
+        toplevel->tile.in_transaction = false;
+        toplevel->tile.waiting = false;
+        toplevel_drop_snapshot(toplevel);
+        struct wlr_box *geo_box = &toplevel->xdg_toplevel->base->geometry;
+        wlr_scene_node_set_position(&toplevel->scene_tree->node, toplevel->tile.box.x - geo_box->x, toplevel->tile.box.y - geo_box->y);
+        hit_index_update(server, toplevel);
+    }
+    server->transaction_waiting = 0;
+    server->transactions++;
+    server->transaction_time_ns += get_time_ns() - server->transaction_start_ns;
+    if (timed_out){
+        server->transactions_timed_out++;
+        wlr_log(WLR_DEBUG, "Layout transaction timed out, applying anyway");
+    }
+}
+
+static int handle_transaction_timeout(void *data){
+    transaction_apply(data, true);
+    return 0;
+}
+
+static void toplevel_begin_tile(struct pwc_toplevel *toplevel, const struct wlr_box *box){
+    struct pwc_server *server = toplevel->server;
+    toplevel->tile.box = *box;
+    toplevel->tile.in_transaction = true;
+    wlr_xdg_toplevel_set_tiled(toplevel->xdg_toplevel, WLR_EDGE_TOP | WLR_EDGE_BOTTOM | WLR_EDGE_LEFT | WLR_EDGE_RIGHT);
+
+    // Windows that keep their size only move, there is nothing to wait for
+    struct wlr_box *geo_box = &toplevel->xdg_toplevel->base->geometry;
+    if (geo_box->width == box->width && geo_box->height == box->height) return;
+    toplevel->tile.serial = wlr_xdg_toplevel_set_size(toplevel->xdg_toplevel, box->width, box->height);
+    toplevel->tile.waiting = true;
+    server->transaction_waiting++;
+    toplevel_snapshot(toplevel);
+}
+
+static int compare_tile_seq(const void *a, const void *b){
+    const struct pwc_toplevel *ta = *(struct pwc_toplevel *const *)a, *tb = *(struct pwc_toplevel *const *)b;
+    return ta->tile.seq < tb->tile.seq ? -1 : ta->tile.seq > tb->tile.seq;
+}
+
+void layout_arrange(struct pwc_workspace *workspace){
+    // Tiles the windows of a workspace on the output at the centre of the layout and starts a transaction for it
+    struct pwc_server *server = workspace->server;
+    if (!workspace->tiling) return;
+    // One transaction at a time, a newer layout supersedes whatever the last one was waiting for
+    if (server->transaction_waiting > 0) transaction_apply(server, false);
+
+    struct wlr_output *wlr_output = wlr_output_layout_get_center_output(server->output_layout);
+    if (wlr_output == NULL) return;
+    struct wlr_box area;
+    wlr_output_layout_get_box(server->output_layout, wlr_output, &area);
+
+    size_t count = 0;
+    struct pwc_toplevel *toplevel;
+    // X11 windows float, they have no configure serials to run a transaction on
+    wl_list_for_each(toplevel, &server->toplevels, link){
+        if (toplevel->workspace == workspace && toplevel->fullscreen_output == NULL && toplevel->xdg_toplevel != NULL) count++;
+    }
+    if (count == 0) return;
+    struct pwc_toplevel **tiles = calloc(count, sizeof(*tiles));
+    if (tiles == NULL) return;
+    size_t i = 0;
+    wl_list_for_each(toplevel, &server->toplevels, link){
+        if (toplevel->workspace == workspace && toplevel->fullscreen_output == NULL && toplevel->xdg_toplevel != NULL) tiles[i++] = toplevel;
+    }
+    // server->toplevels is in focus order, tiles go by age so focusing doesn't reshuffle them
+    qsort(tiles, count, sizeof(*tiles), compare_tile_seq);
+
+    server->transaction_start_ns = get_time_ns();
+    int master_width = count > 1 ? area.width / 2 : area.width;
+    int stack_height = count > 1 ? area.height / (int)(count - 1) : 0;
+    for (i = 0; i < count; i++){
+        struct wlr_box box;
+        if (i == 0) box = (struct wlr_box){ area.x, area.y, master_width, area.height };
+        else{
+            box.x = area.x + master_width;
+            box.y = area.y + (int)(i - 1) * stack_height;
+            box.width = area.width - master_width;
+            // The last window takes the rounding leftovers
+            box.height = i == count - 1 ? area.y + area.height - box.y : stack_height;
+        }
+        toplevel_begin_tile(tiles[i], &box);
+    }
+    free(tiles);
+
+    if (server->transaction_waiting == 0) transaction_apply(server, false);
+    else wl_event_source_timer_update(server->transaction_timer, PWC_TRANSACTION_TIMEOUT_MS);
+}
+
+void layout_toggle(struct pwc_workspace *workspace){
+    // Switches a workspace between tiling and floating. Floating windows stay where tiling left them
+    struct pwc_server *server = workspace->server;
+    workspace->tiling = !workspace->tiling;
+    if (workspace->tiling){
+        if (server->grabbed_toplevel != NULL && server->grabbed_toplevel->workspace == workspace) reset_cursor_mode(server);
+        layout_arrange(workspace);
+        return;
+    }
+    if (server->transaction_waiting > 0) transaction_apply(server, false);
+    struct pwc_toplevel *toplevel;
+    wl_list_for_each(toplevel, &server->toplevels, link){
+        if (toplevel->workspace == workspace && toplevel->xdg_toplevel != NULL) wlr_xdg_toplevel_set_tiled(toplevel->xdg_toplevel, WLR_EDGE_NONE);
+    }
+}
+
+void layout_toplevel_commit(struct pwc_toplevel *toplevel){
+    // A window in the transaction committed. Once it carries the configure, it stops holding the transaction up
+    struct pwc_server *server = toplevel->server;
+    if (!toplevel->tile.waiting) return;
+    if ((int32_t)(toplevel->xdg_toplevel->base->current.configure_serial - toplevel->tile.serial) < 0) return;
+    toplevel->tile.waiting = false;
+    if (--server->transaction_waiting == 0) transaction_apply(server, false);
+}
+
+void layout_toplevel_remove(struct pwc_toplevel *toplevel){
+    // The window is going away, don't let the transaction wait for it
+    struct pwc_server *server = toplevel->server;
+    if (!toplevel->tile.in_transaction) return;
+    toplevel->tile.in_transaction = false;
+    toplevel_drop_snapshot(toplevel);
+    if (!toplevel->tile.waiting) return;
+    toplevel->tile.waiting = false;
+    if (--server->transaction_waiting == 0) transaction_apply(server, false);
+}
+
+bool layout_init(struct pwc_server *server){
+    server->transaction_timer = wl_event_loop_add_timer(wl_display_get_event_loop(server->wl_display), handle_transaction_timeout, server);
+    return server->transaction_timer != NULL;
+}
+
+void layout_finish(struct pwc_server *server){
+    wl_event_source_remove(server->transaction_timer);
+}
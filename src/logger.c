@@ -0,0 +1,171 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+#include "server.h"
+
+// Asynchronous logging. Messages are formatted on the calling thread into a fixed ring of slots and a background..
+// thread writes them out, so a slow terminal or disk never stalls the event loop. When the ring is full the message..
+// is dropped and counted instead of waiting, the writer notes how many went missing once it catches up.
+//
+// There is one producer at a time: a thread that finds another one mid-write drops its message rather than spin.
+
+struct log_slot {
+    int64_t time_ns;
+    enum wlr_log_importance importance;
+    char text[PWC_LOG_LINE_MAX];
+};
+
+static struct {
+    FILE *file;
+    pthread_t thread;
+    sem_t ready;
+    atomic_bool running;
+    atomic_flag producing;
+    // head is only advanced by the producer, tail only by the writer thread
+    atomic_uint_fast64_t head, tail;
+    atomic_uint_fast64_t written, dropped;
+    int64_t start_ns;
+    struct log_slot slots[PWC_LOG_SLOTS];
+} logger = { .producing = ATOMIC_FLAG_INIT };
+
+static const char *const importance_colors[] = {
+    [WLR_SILENT] = "",
+    [WLR_ERROR] = "\x1B[1;31m",
+    [WLR_INFO] = "\x1B[1;34m",
+    [WLR_DEBUG] = "\x1B[1;90m",
+};
+
+static void logger_callback(enum wlr_log_importance importance, const char *fmt, va_list args){
+    if (importance > wlr_log_get_verbosity()) return;
+    if (atomic_flag_test_and_set_explicit(&logger.producing, memory_order_acquire)){
+        atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+        return;
+    }
+    uint64_t head = atomic_load_explicit(&logger.head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&logger.tail, memory_order_acquire);
+    if (head - tail >= PWC_LOG_SLOTS){
+        atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+        atomic_flag_clear_explicit(&logger.producing, memory_order_release);
+        return;
+    }
+    struct log_slot *slot = &logger.slots[head % PWC_LOG_SLOTS];
+    slot->time_ns = get_time_ns();
+    slot->importance = importance;
+    // Long messages are cut at the slot size
+    vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+    atomic_store_explicit(&logger.head, head + 1, memory_order_release);
+    atomic_flag_clear_explicit(&logger.producing, memory_order_release);
+    sem_post(&logger.ready);
+}
+
+static void write_slot(const struct log_slot *slot, bool colored){
+    int64_t elapsed = slot->time_ns - logger.start_ns;
+    int64_t ms = elapsed / 1000000;
+    fprintf(logger.file, "%02d:%02d:%02d.%03d ", (int)(ms / 3600000), (int)(ms / 60000 % 60), (int)(ms / 1000 % 60), (int)(ms % 1000));
+    if (colored) fprintf(logger.file, "%s%s\x1B[0m\n", importance_colors[slot->importance], slot->text);
+    else fprintf(logger.file, "%s\n", slot->text);
+}
+
+static void *logger_thread(void *data){
+    (void)data;
+    bool colored = isatty(fileno(logger.file));
+    uint64_t dropped_reported = 0;
+    while (true){
+        while (sem_wait(&logger.ready) != 0 && errno == EINTR);
+        uint64_t tail = atomic_load_explicit(&logger.tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&logger.head, memory_order_acquire);
+        // Everything published so far goes out in one go, then a single flush
+        for (; tail != head; tail++){
+            write_slot(&logger.slots[tail % PWC_LOG_SLOTS], colored);
+            atomic_store_explicit(&logger.tail, tail + 1, memory_order_release);
+            atomic_fetch_add_explicit(&logger.written, 1, memory_order_relaxed);
+        }
+        uint64_t dropped = atomic_load_explicit(&logger.dropped, memory_order_relaxed);
+        if (dropped != dropped_reported){
+            fprintf(logger.file, "[%" PRIu64 " log messages dropped]\n", dropped - dropped_reported);
+            dropped_reported = dropped;
+        }
+        fflush(logger.file);
+        if (!atomic_load_explicit(&logger.running, memory_order_acquire) &&
+                atomic_load_explicit(&logger.head, memory_order_acquire) == tail) break;
+    }
+    return NULL;
+}
+
+bool logger_init(enum wlr_log_importance verbosity, const char *path){
+    // Routes wlr_log() through the ring buffer, writing to path. Falls back to synchronous stderr logging on failure
+    logger.file = fopen(path, "a");
+    if (logger.file == NULL){
+        wlr_log_init(verbosity, NULL);
+        wlr_log_errno(WLR_ERROR, "failed to open log file %s", path);
+        return false;
+    }
+    logger.start_ns = get_time_ns();
+    sem_init(&logger.ready, 0, 0);
+    atomic_store(&logger.running, true);
+    // The thread starts before the event loop blocks the signals it reads from a signalfd (SIGUSR1, SIGUSR2,..
+    // SIGHUP, SIGCHLD). Left unblocked here, the kernel could deliver them to this thread instead, so it blocks everything
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int err = pthread_create(&logger.thread, NULL, logger_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0){
+        atomic_store(&logger.running, false);
+        sem_destroy(&logger.ready);
+        fclose(logger.file);
+        logger.file = NULL;
+        wlr_log_init(verbosity, NULL);
+        wlr_log(WLR_ERROR, "failed to start the logging thread: %s", strerror(err));
+        return false;
+    }
+    wlr_log_init(verbosity, logger_callback);
+    return true;
+}
+
+void logger_finish(void){
+    // Writes out whatever is still queued and puts wlr_log() back on stderr
+    if (logger.file == NULL) return;
+    wlr_log_init(wlr_log_get_verbosity(), NULL);
+    atomic_store_explicit(&logger.running, false, memory_order_release);
+    sem_post(&logger.ready);
+    pthread_join(logger.thread, NULL);
+    sem_destroy(&logger.ready);
+    fclose(logger.file);
+    logger.file = NULL;
+}
+
+void logger_set_verbosity(enum wlr_log_importance verbosity){
+    // Changes the level at runtime. The ring callback reads the level on every message, so keeping whichever..
+    // callback is installed is enough
+    wlr_log_init(verbosity, logger.file != NULL ? logger_callback : NULL);
+}
+
+void logger_stats(uint64_t *written, uint64_t *dropped){
+    *written = atomic_load_explicit(&logger.written, memory_order_relaxed);
+    *dropped = atomic_load_explicit(&logger.dropped, memory_order_relaxed);
+}
+
+bool logger_parse_level(const char *name, enum wlr_log_importance *verbosity){
+    // -v takes silent, error, info or debug
+    static const char *const names[] = {
+        [WLR_SILENT] = "silent",
+        [WLR_ERROR] = "error",
+        [WLR_INFO] = "info",
+        [WLR_DEBUG] = "debug",
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++){
+        if (strcmp(name, names[i]) == 0){
+            *verbosity = i;
+            return true;
+        }
+    }
+    return false;
+}
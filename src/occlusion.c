@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <time.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#if HAVE_XWAYLAND
+#include <wlr/xwayland.h>
+#endif
+#include "server.h"
+
+// Frame callbacks for hidden surfaces. The scene works out which part of every buffer is visible, opaque buffers..
+// above it subtracted, and only sends frame done to buffers visible on some output. A surface that is completely..
+// covered or off-screen therefore gets no callbacks, and resumes with the first frame it shows up in again.
+//
+// Starving it for good makes some clients block forever in their swap (EGL with a swap interval of 1), so those..
+// still get a callback every PWC_OCCLUDED_FRAME_MS. Windows on other workspaces are disabled in the scene and stay..
+// fully stopped until their workspace is shown.
+//
+// The timer only runs while a hidden surface is actually waiting on a callback. It is armed when any surface of a..
+// window on the shown workspace (subsurfaces and popups included) commits with a callback while hidden, and after..
+// every rendered frame when the scene change hid a surface that is still waiting. A tick serves every waiting..
+// surface and keeps going as long as it served any, so an idle desktop, or one where nothing is hidden, never..
+// wakes up for this.
+
+struct occlusion_iter_data {
+    struct pwc_server *server;
+    struct timespec now;
+    bool served;
+};
+
+struct occlusion_surface {
+    struct pwc_server *server;
+    struct wlr_surface *surface;
+    struct wl_listener commit;
+    struct wl_listener destroy;
+};
+
+static void occluded_frame_iter(struct wlr_scene_buffer *buffer, int sx, int sy, void *data){
+    struct occlusion_iter_data *iter_data = data;
+    // Surfaces with a primary output are visible and paced by that output
+    if (buffer->primary_output != NULL) return;
+    struct wlr_scene_surface *scene_surface = wlr_scene_surface_try_from_buffer(buffer);
+    if (scene_surface == NULL) return;
+    iter_data->server->surfaces_occluded++;
+    if (wl_list_empty(&scene_surface->surface->current.frame_callback_list)) return;
+    wlr_scene_buffer_send_frame_done(buffer, &iter_data->now);
+    iter_data->server->occluded_frames_sent++;
+    iter_data->served = true;
+}
+
+static int handle_occlusion_timer(void *data){
+    // Recounts the hidden surfaces on the shown workspace and gives the ones waiting on a frame their slow callback
+    struct pwc_server *server = data;
+    struct occlusion_iter_data iter_data = { .server = server };
+    clock_gettime(CLOCK_MONOTONIC, &iter_data.now);
+    server->surfaces_occluded = 0;
+    struct pwc_toplevel *toplevel;
+    wl_list_for_each(toplevel, &server->toplevels, link){
+        if (toplevel->workspace != server->active_workspace) continue;
+        wlr_scene_node_for_each_buffer(&toplevel->scene_tree->node, occluded_frame_iter, &iter_data);
+    }
+    if (server->surfaces_occluded > server->surfaces_occluded_max) server->surfaces_occluded_max = server->surfaces_occluded;
+    // Clients that got a callback usually ask for the next one right away, keep ticking until a tick serves nobody
+    server->occlusion_armed = iter_data.served;
+    if (server->occlusion_armed) wl_event_source_timer_update(server->occlusion_timer, PWC_OCCLUDED_FRAME_MS);
+    return 0;
+}
+
+static void occluded_pending_iter(struct wlr_scene_buffer *buffer, int sx, int sy, void *data){
+    bool *pending = data;
+    if (buffer->primary_output != NULL) return;
+    struct wlr_scene_surface *scene_surface = wlr_scene_surface_try_from_buffer(buffer);
+    if (scene_surface != NULL && !wl_list_empty(&scene_surface->surface->current.frame_callback_list)) *pending = true;
+}
+
+static bool occlusion_toplevel_pending(struct pwc_toplevel *toplevel){
+    // Whether any hidden surface of a window on the shown workspace waits on a frame callback the scene won't send
+    if (toplevel->scene_tree == NULL || toplevel->workspace != toplevel->server->active_workspace) return false;
+    bool pending = false;
+    wlr_scene_node_for_each_buffer(&toplevel->scene_tree->node, occluded_pending_iter, &pending);
+    return pending;
+}
+
+static void occlusion_arm(struct pwc_server *server){
+    server->occlusion_armed = true;
+    wl_event_source_timer_update(server->occlusion_timer, PWC_OCCLUDED_FRAME_MS);
+}
+
+void occlusion_scene_changed(struct pwc_server *server){
+    // Called after an output rendered a frame. Whatever changed in the scene (a window raised or moved over another,..
+    // one going fullscreen, one moved off-screen) may have hidden a surface that committed while it was visible and..
+    // is still waiting on its callback
+    if (server->occlusion_armed) return;
+    struct pwc_toplevel *toplevel;
+    wl_list_for_each(toplevel, &server->toplevels, link){
+        if (occlusion_toplevel_pending(toplevel)){
+            occlusion_arm(server);
+            return;
+        }
+    }
+}
+
+static struct pwc_toplevel *occlusion_surface_toplevel(struct wlr_surface *surface){
+    // The window a surface belongs to. Subsurfaces go up to their root, popups up the scene to the first tree..
+    // carrying a toplevel, same as in desktop_toplevel_at()
+    struct wlr_surface *root = wlr_surface_get_root_surface(surface);
+    struct wlr_xdg_surface *xdg_surface = wlr_xdg_surface_try_from_wlr_surface(root);
+    if (xdg_surface != NULL){
+        struct wlr_scene_tree *tree = xdg_surface->data;
+        while (tree != NULL && tree->node.data == NULL) tree = tree->node.parent;
+        return tree != NULL ? tree->node.data : NULL;
+    }
+#if HAVE_XWAYLAND
+    struct wlr_xwayland_surface *xsurface = wlr_xwayland_surface_try_from_wlr_surface(root);
+    if (xsurface != NULL) return xsurface->data;
+#endif
+    return NULL;
+}
+
+static void occlusion_surface_commit(struct wl_listener *listener, void *data){
+    // A surface asking for a frame while hidden starts the slow clock. Cheap checks first, this runs for every..
+    // commit of every surface
+    struct occlusion_surface *osurface = wl_container_of(listener, osurface, commit);
+    struct pwc_server *server = osurface->server;
+    if (server->occlusion_armed || wl_list_empty(&osurface->surface->current.frame_callback_list)) return;
+    struct pwc_toplevel *toplevel = occlusion_surface_toplevel(osurface->surface);
+    if (toplevel != NULL && occlusion_toplevel_pending(toplevel)) occlusion_arm(server);
+}
+
+static void occlusion_surface_destroy(struct wl_listener *listener, void *data){
+    struct occlusion_surface *osurface = wl_container_of(listener, osurface, destroy);
+    wl_list_remove(&osurface->commit.link);
+    wl_list_remove(&osurface->destroy.link);
+    free(osurface);
+}
+
+static void occlusion_new_surface(struct wl_listener *listener, void *data){
+    // Every surface gets a commit listener, the role isn't known yet and subsurfaces have no commit event of..
+    // their own reaching the window
+    struct pwc_server *server = wl_container_of(listener, server, occlusion_new_surface);
+    struct wlr_surface *surface = data;
+    struct occlusion_surface *osurface = calloc(1, sizeof(*osurface));
+    if (osurface == NULL) return;
+    osurface->server = server;
+    osurface->surface = surface;
+    osurface->commit.notify = occlusion_surface_commit;
+    wl_signal_add(&surface->events.commit, &osurface->commit);
+    osurface->destroy.notify = occlusion_surface_destroy;
+    wl_signal_add(&surface->events.destroy, &osurface->destroy);
+}
+
+bool occlusion_init(struct pwc_server *server){
+    server->occlusion_timer = wl_event_loop_add_timer(wl_display_get_event_loop(server->wl_display), handle_occlusion_timer, server);
+    if (server->occlusion_timer == NULL) return false;
+    server->occlusion_new_surface.notify = occlusion_new_surface;
+    wl_signal_add(&server->compositor->events.new_surface, &server->occlusion_new_surface);
+    return true;
+}
+
+void occlusion_finish(struct pwc_server *server){
+    wl_list_remove(&server->occlusion_new_surface.link);
+    wl_event_source_remove(server->occlusion_timer);
+}
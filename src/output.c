@@ -0,0 +1,387 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wayland-server-core.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_tearing_control_v1.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+#include "server.h"
+
+static int64_t output_next_vblank(struct pwc_output *output, int64_t after_ns){
+    // Predicts the first vblank after the given time from the last present timestamp. 0 when unknown
+    if (output->last_present_ns == 0 || output->refresh_ns <= 0) return 0;
+    int64_t elapsed = after_ns - output->last_present_ns;
+    if (elapsed < 0) return output->last_present_ns;
+    return output->last_present_ns + (elapsed / output->refresh_ns + 1) * output->refresh_ns;
+}
+
+int64_t output_render_budget(struct pwc_output *output){
+    // Time to reserve before the vblank: worst recent composite plus the safety margin
+    int64_t worst = 0;
+    for (size_t i = 0; i < PWC_RENDER_SAMPLES; i++){
+        if (output->render_times_ns[i] > worst) worst = output->render_times_ns[i];
+    }
+    return worst + output->render_margin_ns;
+}
+
+static struct pwc_toplevel *output_fullscreen_toplevel(struct pwc_output *output){
+    // Returns the topmost toplevel that is fullscreen on this output, on the active workspace
+    struct pwc_toplevel *toplevel;
+    wl_list_for_each(toplevel, &output->server->toplevels, link){
+        if (toplevel->fullscreen_output == output->wlr_output && toplevel->workspace == output->server->active_workspace) return toplevel;
+    }
+    return NULL;
+}
+
+static struct wlr_surface *output_focused_fullscreen(struct pwc_output *output){
+    // The focused surface, if it belongs to the window fullscreen on this output
+    struct wlr_surface *surface = output->server->seat->keyboard_state.focused_surface;
+    if (surface == NULL) return NULL;
+    struct pwc_toplevel *toplevel = output_fullscreen_toplevel(output);
+    if (toplevel == NULL || toplevel_surface(toplevel) != surface) return NULL;
+    return surface;
+}
+
+static bool output_allows_tearing(struct pwc_output *output){
+    // Tearing is only allowed for the focused surface, when it is fullscreen on this output and has asked for..
+    // async presentation through the tearing-control protocol
+    struct wlr_surface *surface = output_focused_fullscreen(output);
+    // tearing-control is one of the globals set up after the first frame
+    if (surface == NULL || output->server->tearing_control == NULL) return false;
+    return wlr_tearing_control_manager_v1_surface_hint_from_surface(output->server->tearing_control, surface) ==
+            WP_TEARING_CONTROL_V1_PRESENTATION_HINT_ASYNC;
+}
+
+static void output_update_vrr(struct pwc_output *output, struct wlr_output_state *state){
+    // Adaptive sync follows the -o setting, or with auto, whether a fullscreen window is focused on this output.
+    // The change rides along with the frame being committed
+    struct wlr_output *wlr_output = output->wlr_output;
+    enum pwc_vrr mode = output->config != NULL ? output->config->vrr : PWC_VRR_AUTO;
+    bool wanted = mode == PWC_VRR_ON || (mode == PWC_VRR_AUTO && output_focused_fullscreen(output) != NULL);
+    bool enabled = wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+    if (wanted == enabled || !wlr_output->adaptive_sync_supported || (wanted && output->vrr_refused)) return;
+
+    wlr_output_state_set_adaptive_sync_enabled(state, wanted);
+    if (!wlr_output_test_state(wlr_output, state)){
+        state->committed &= ~WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED;
+        if (wanted) output->vrr_refused = true;
+        wlr_log(WLR_INFO, "Output %s: backend refused to %s adaptive sync", wlr_output->name, wanted ? "enable" : "disable");
+        return;
+    }
+    wlr_log(WLR_INFO, "Output %s: adaptive sync %s", wlr_output->name, wanted ? "enabled" : "disabled");
+}
+
+static void count_buffers_iter(struct wlr_scene_buffer *buffer, int sx, int sy, void *data){
+    int *count = data;
+    (*count)++;
+}
+
+static const char *output_scanout_blocker(struct pwc_output *output){
+    // The scene decides on direct scanout by itself, this only guesses why it didn't happen so it can be logged
+    struct pwc_toplevel *toplevel = output_fullscreen_toplevel(output);
+    if (toplevel == NULL) return "no fullscreen window";
+    int buffers = 0;
+    wlr_scene_node_for_each_buffer(&toplevel->scene_tree->node, count_buffers_iter, &buffers);
+    if (buffers != 1) return "window has subsurfaces or popups";
+    const char *disabled = getenv("WLR_SCENE_DISABLE_DIRECT_SCANOUT");
+    if (disabled != NULL && strcmp(disabled, "1") == 0) return "disabled by WLR_SCENE_DISABLE_DIRECT_SCANOUT";
+    struct wlr_surface *surface = toplevel_surface(toplevel);
+    if (surface->current.buffer_width != output->wlr_output->width || surface->current.buffer_height != output->wlr_output->height){
+        return "buffer size does not match the output mode";
+    }
+    return "buffer rejected by the output (format, modifier or software cursor)";
+}
+
+static void output_update_scanout(struct pwc_output *output, struct wlr_scene_output *scene_output){
+    // Logs every time the output switches between direct scanout and composition
+    bool scanout = scene_output->prev_scanout;
+    const char *blocker = scanout ? NULL : output_scanout_blocker(output);
+    if (scanout) output->frames_scanned_out++;
+    if (scanout != output->direct_scanout || (blocker != NULL && blocker != output->scanout_blocker)){
+        if (scanout) wlr_log(WLR_INFO, "Output %s: direct scanout active", output->wlr_output->name);
+        else wlr_log(WLR_INFO, "Output %s: compositing, %s", output->wlr_output->name, blocker);
+    }
+    output->direct_scanout = scanout;
+    output->scanout_blocker = blocker;
+}
+
+static bool output_commit(struct pwc_output *output, struct wlr_scene_output *scene_output, bool *torn){
+    // Renders the scene into an output state and commits it, with an async page flip when tearing is allowed.
+    // torn tells whether the committed frame went out with one
+    struct wlr_output_state state;
+    wlr_output_state_init(&state);
+    int64_t trace_start_ns = trace_begin();
+    if (!wlr_scene_output_build_state(scene_output, &state, NULL)){
+        wlr_output_state_finish(&state);
+        return false;
+    }
+    trace_end(PWC_TRACE_OUTPUTS, "composite", trace_start_ns, output->wlr_output->name);
+    output_update_scanout(output, scene_output);
+    output_update_vrr(output, &state);
+
+    if (output_allows_tearing(output)){
+        state.tearing_page_flip = true;
+        if (!wlr_output_test_state(output->wlr_output, &state)){
+            // Backend can't do async page flips for this state, fall back to vsync
+            state.tearing_page_flip = false;
+            output->tearing_refused++;
+        }
+    }
+
+    trace_start_ns = trace_begin();
+    bool ok = wlr_output_commit_state(output->wlr_output, &state);
+    trace_end(PWC_TRACE_OUTPUTS, "output commit", trace_start_ns, output->wlr_output->name);
+    *torn = ok && state.tearing_page_flip;
+    if (*torn) output->frames_torn++;
+    wlr_output_state_finish(&state);
+    return ok;
+}
+
+static void output_render(struct pwc_output *output){
+    struct wlr_scene *scene = output->server->scene;
+    struct wlr_scene_output *scene_output = wlr_scene_get_scene_output(scene, output->wlr_output);
+    output->render_scheduled = false;
+    // Enabled but taken out of the layout through output management, there is nothing to show
+    if (scene_output == NULL) return;
+
+    bool committed = false;
+    bool torn = false;
+    if (!wlr_scene_output_needs_frame(scene_output)){
+        // Nothing changed on this output, so there is nothing to commit. Clients waiting on a frame callback still..
+        // get frame done below, a single walk that does nothing when none are waiting
+        output->frames_skipped++;
+        output->present_back_to_back = false;
+    }
+    else{
+        // Render the scene and commit, keeping track of how long that took
+        int64_t start = get_time_ns();
+        if (output_commit(output, scene_output, &torn)){
+            committed = true;
+            output->frames_committed++;
+            output->render_times_ns[output->render_time_index] = get_time_ns() - start;
+            output->render_time_index = (output->render_time_index + 1) % PWC_RENDER_SAMPLES;
+            output->target_present_ns = output_next_vblank(output, start);
+            occlusion_scene_changed(output->server);
+        }
+        else{
+            wlr_log(WLR_DEBUG, "Failed to commit frame on output %s", output->wlr_output->name);
+            output->frames_skipped++;
+            output->present_back_to_back = false;
+        }
+    }
+
+    // Clients pace themselves on the frame done timestamp, so it should be when the frame shows up rather than..
+    // when we got done with it. The next vblank is extrapolated from the last real present event. An async flip..
+    // shows up right away and with adaptive sync the refresh follows the commits, so there is no vblank to..
+    // extrapolate and those get the current time
+    int64_t now_ns = get_time_ns();
+    bool vrr = output->wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+    int64_t done_ns = committed && !torn && !vrr ? output_next_vblank(output, now_ns) : 0;
+    if (done_ns == 0) done_ns = now_ns;
+    struct timespec done = { .tv_sec = done_ns / 1000000000, .tv_nsec = done_ns % 1000000000 };
+    wlr_scene_output_send_frame_done(scene_output, &done);
+    trace_instant(PWC_TRACE_OUTPUTS, "frame done", output->wlr_output->name);
+}
+
+static int output_handle_render_timer(void *data){
+    // The render deadline for this output has been reached
+    struct pwc_output *output = data;
+    output_render(output);
+    return 0;
+}
+
+static void output_frame(struct wl_listener *listener, void *data){
+    // Function called every time an output is ready to display a frame, generally at output refresh rate.
+    struct pwc_output *output = wl_container_of(listener, output, frame);
+    trace_instant(PWC_TRACE_OUTPUTS, "frame", output->wlr_output->name);
+    // No point waiting for a vblank when the frame is going to tear anyway
+    if (!output->server->render_late || output_allows_tearing(output)){
+        output_render(output);
+        return;
+    }
+    if (output->render_scheduled) return;
+
+    // Start rendering as late as possible while still making the next vblank. Anything that arrives until..
+    // then (pointer motion, client commits) makes it into this frame instead of the next one.
+    int64_t now = get_time_ns();
+    int64_t vblank = output_next_vblank(output, now);
+    int64_t delay_ms = vblank == 0 ? 0 : (vblank - output_render_budget(output) - now) / 1000000;
+    if (delay_ms < 1){
+        output_render(output);
+        return;
+    }
+    output->render_scheduled = true;
+    wl_event_source_timer_update(output->render_timer, delay_ms);
+}
+
+static void output_present(struct wl_listener *listener, void *data){
+    // Event is raised when a committed frame is actually shown ( or dropped )
+    struct pwc_output *output = wl_container_of(listener, output, present);
+    struct wlr_output_event_present *event = data;
+    if (!event->presented){
+        output->frames_discarded++;
+        // The dropped frame's deadline says nothing about the next one
+        output->target_present_ns = 0;
+        output->present_back_to_back = false;
+        return;
+    }
+    int64_t previous_present_ns = output->last_present_ns;
+
+    output->last_present_ns = timespec_to_ns(&event->when);
+    // Presentation timestamps are on CLOCK_MONOTONIC like everything else in the trace
+    trace_instant_at(PWC_TRACE_OUTPUTS, "present", output->last_present_ns, output->wlr_output->name);
+    if (output->server->first_frame_ns == 0) startup_frame_presented(output->server, output->last_present_ns);
+    output->refresh_ns = event->refresh;
+    if (output->refresh_ns <= 0 && output->wlr_output->refresh > 0){
+        output->refresh_ns = 1000000000000LL / output->wlr_output->refresh;
+    }
+
+    // Vblanks since the previous present. The hardware sequence counter is exact, backends without one (seq 0)..
+    // fall back to rounding the elapsed time. Only counted when nothing was skipped since that present, otherwise..
+    // the gap is idle time rather than missed vblanks
+    uint64_t vblanks = 0;
+    if (output->present_back_to_back){
+        if (event->seq != 0 && output->last_present_seq != 0) vblanks = event->seq - output->last_present_seq;
+        else if (previous_present_ns != 0 && output->refresh_ns > 0){
+            vblanks = (output->last_present_ns - previous_present_ns + output->refresh_ns / 2) / output->refresh_ns;
+        }
+    }
+    output->last_present_seq = event->seq;
+    output->present_back_to_back = true;
+    if (vblanks > 0) output->present_intervals[vblanks < PWC_PRESENT_BUCKETS ? vblanks - 1 : PWC_PRESENT_BUCKETS - 1]++;
+
+    if (!output->server->render_late || output->target_present_ns == 0) return;
+    if (output->last_present_ns > output->target_present_ns + output->refresh_ns / 2){
+        // Missed the vblank the frame was aimed at. Back off so the next frames start earlier
+        output->deadlines_missed++;
+        output->render_margin_ns *= 2;
+        if (output->refresh_ns > 0 && output->render_margin_ns > output->refresh_ns) output->render_margin_ns = output->refresh_ns;
+    }
+    else{
+        // On time, slowly give the margin back
+        output->render_margin_ns -= output->render_margin_ns / 64;
+        if (output->render_margin_ns < PWC_RENDER_MARGIN_MIN_NS) output->render_margin_ns = PWC_RENDER_MARGIN_MIN_NS;
+    }
+    output->target_present_ns = 0;
+}
+
+static void output_request_state(struct wl_listener *listener, void *data){
+    // Function is called when the backend requests a new state for the output
+    struct pwc_output *output = wl_container_of(listener, output, request_state);
+    const struct wlr_output_event_request_state *event = data;
+    wlr_output_commit_state(output->wlr_output, event->state);
+}
+
+static void output_bind(struct wl_listener *listener, void *data){
+    // A client bound this output's wl_output global
+    struct pwc_output *output = wl_container_of(listener, output, bind);
+    struct wlr_output_event_bind *event = data;
+    workspace_output_bind(output->server, event->resource);
+}
+
+static void output_destroy(struct wl_listener *listener, void *data){
+    struct pwc_output *output = wl_container_of(listener, output, destroy);
+
+    // Windows that were fullscreen on this output go back to being windows
+    struct pwc_toplevel *toplevel, *tmp;
+    wl_list_for_each_safe(toplevel, tmp, &output->server->toplevels, link){
+        if (toplevel->fullscreen_output == output->wlr_output) toplevel_set_fullscreen(toplevel, false, NULL);
+    }
+
+    workspace_output_remove(output->server, output->wlr_output);
+
+    wl_event_source_remove(output->render_timer);
+    wl_list_remove(&output->bind.link);
+    wl_list_remove(&output->frame.link);
+    wl_list_remove(&output->request_state.link);
+    wl_list_remove(&output->present.link);
+    wl_list_remove(&output->destroy.link);
+    wl_list_remove(&output->link);
+    free(output);
+}
+
+void server_new_output(struct wl_listener *listener, void *data){
+    // Event is raised by the backend when a new output becomes available
+    struct pwc_server *server = wl_container_of(listener, server, new_output);
+    struct wlr_output *wlr_output = data;
+
+    // Configures the output created by the backend to use wlroot allocator and renderer
+    wlr_output_init_render(wlr_output, server->allocator, server->renderer);
+
+    // The output may be disabled, switch it on
+    struct wlr_output_state state;
+    wlr_output_state_init(&state);
+    wlr_output_state_set_enabled(&state, true);
+
+    // Some backends don't have modes.
+    // DRM + KMS does, and they need a mode before they can be used for output.
+    // Mode is a tuple of (width, height, refresh rate) and each monitor supports only a..
+    // specific set of modes. The one from -o is used if there is one, see output_config_apply()
+    struct pwc_output_config *config = output_config_find(server, wlr_output->name);
+    output_config_apply(wlr_output, config, &state);
+
+    // Automatically applies the new output state
+    if (!wlr_output_commit_state(wlr_output, &state) && config != NULL){
+        // Don't lose the output over a bad -o, retry with the defaults
+        wlr_log(WLR_ERROR, "Output %s: configuration rejected, using defaults", wlr_output->name);
+        wlr_output_state_finish(&state);
+        wlr_output_state_init(&state);
+        wlr_output_state_set_enabled(&state, true);
+        output_config_apply(wlr_output, NULL, &state);
+        wlr_output_commit_state(wlr_output, &state);
+    }
+    wlr_output_state_finish(&state);
+
+    // Allocates and configures our state for this output
+    struct pwc_output *output = calloc(1, sizeof(*output));
+    output->wlr_output = wlr_output;
+    output->server = server;
+    output->config = config;
+    wlr_output->data = output;
+    output->render_margin_ns = PWC_RENDER_MARGIN_START_NS;
+    output->render_timer = wl_event_loop_add_timer(wl_display_get_event_loop(server->wl_display), output_handle_render_timer, output);
+
+    // Sets up a listener for the frame event
+    output->frame.notify = output_frame;
+    wl_signal_add(&wlr_output->events.frame, &output->frame);
+
+    // Sets up a listener for the state request event
+    output->request_state.notify = output_request_state;
+    wl_signal_add(&wlr_output->events.request_state, &output->request_state);
+
+    // Sets up a listener for the present event, which drives the render deadline
+    output->present.notify = output_present;
+    wl_signal_add(&wlr_output->events.present, &output->present);
+
+    output->bind.notify = output_bind;
+    wl_signal_add(&wlr_output->events.bind, &output->bind);
+
+    // Sets up a listener for the destroy event
+    output->destroy.notify = output_destroy;
+    wl_signal_add(&wlr_output->events.destroy, &output->destroy);
+
+    wl_list_insert(&server->outputs, &output->link);
+
+    output_add_to_layout(output, config != NULL && config->has_position, config != NULL ? config->x : 0, config != NULL ? config->y : 0);
+}
+
+void output_add_to_layout(struct pwc_output *output, bool has_position, int x, int y){
+    // Adds the output to the output layout, or moves it if it's already there.
+    // Without a position, auto_add arranges outputs from left to right in the order they appear.
+    // The output layout utility automatically adds a wl_output global to the display..
+    // which wayland clients can see to find out information about output.
+    struct pwc_server *server = output->server;
+    struct wlr_output_layout_output *l_output = has_position ?
+        wlr_output_layout_add(server->output_layout, output->wlr_output, x, y) :
+        wlr_output_layout_add_auto(server->output_layout, output->wlr_output);
+    if (l_output == NULL || wlr_scene_get_scene_output(server->scene, output->wlr_output) != NULL) return;
+    // Removing an output from the layout takes its scene output with it, so it may need a new one
+    struct wlr_scene_output *scene_output = wlr_scene_output_create(server->scene, output->wlr_output);
+    wlr_scene_output_layout_add_output(server->scene_layout, l_output, scene_output);
+}
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_output_management_v1.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+#include "server.h"
+
+// Per-output configuration from the command line, and wlr-output-management so it can be changed at runtime.
+//
+// -o NAME:mode=WIDTHxHEIGHT[@HZ],scale=S,x=X,y=Y,vrr=off|on|auto
+//
+// Any key can be left out. Without a mode the output gets its preferred resolution at the highest refresh rate..
+// it offers. Outputs without a mode list (headless, nested) take the mode as a custom mode.
+
+bool output_config_parse(struct pwc_server *server, const char *spec){
+    // Adds the configuration given with -o. Returns false on malformed input
+    const char *colon = strchr(spec, ':');
+    if (colon == NULL || colon == spec) return false;
+    struct pwc_output_config *config = calloc(1, sizeof(*config));
+    if (config == NULL) return false;
+    config->name = strndup(spec, colon - spec);
+    config->vrr = PWC_VRR_AUTO;
+
+    char *options = strdup(colon + 1);
+    bool ok = config->name != NULL && options != NULL;
+    char *saveptr = NULL;
+    for (char *option = ok ? strtok_r(options, ",", &saveptr) : NULL; option != NULL && ok; option = strtok_r(NULL, ",", &saveptr)){
+        char *value = strchr(option, '=');
+        if (value == NULL){ok = false; break;}
+        *value++ = '\0';
+        if (strcmp(option, "mode") == 0){
+            double hz = 0;
+            int matched = sscanf(value, "%dx%d@%lf", &config->width, &config->height, &hz);
+            ok = matched >= 2 && config->width > 0 && config->height > 0 && hz >= 0;
+            config->refresh_mhz = (int)(hz * 1000 + 0.5);
+        }
+        else if (strcmp(option, "scale") == 0) ok = sscanf(value, "%lf", &config->scale) == 1 && config->scale > 0;
+        else if (strcmp(option, "x") == 0){ok = sscanf(value, "%d", &config->x) == 1; config->has_position = true;}
+        else if (strcmp(option, "y") == 0){ok = sscanf(value, "%d", &config->y) == 1; config->has_position = true;}
+        else if (strcmp(option, "vrr") == 0){
+            if (strcmp(value, "off") == 0) config->vrr = PWC_VRR_OFF;
+            else if (strcmp(value, "on") == 0) config->vrr = PWC_VRR_ON;
+            else if (strcmp(value, "auto") == 0) config->vrr = PWC_VRR_AUTO;
+            else ok = false;
+        }
+        else ok = false;
+    }
+    free(options);
+    if (!ok){
+        free(config->name);
+        free(config);
+        return false;
+    }
+    wl_list_insert(server->output_configs.prev, &config->link);
+    return true;
+}
+
+void output_configs_finish(struct pwc_server *server){
+    struct pwc_output_config *config, *tmp;
+    wl_list_for_each_safe(config, tmp, &server->output_configs, link){
+        wl_list_remove(&config->link);
+        free(config->name);
+        free(config);
+    }
+}
+
+struct pwc_output_config *output_config_find(struct pwc_server *server, const char *name){
+    struct pwc_output_config *config;
+    wl_list_for_each(config, &server->output_configs, link){
+        if (strcmp(config->name, name) == 0) return config;
+    }
+    return NULL;
+}
+
+static struct wlr_output_mode *pick_mode(struct wlr_output *wlr_output, int width, int height, int refresh_mhz){
+    // The mode of the given size closest to the refresh rate, or the fastest one when no rate is given
+    struct wlr_output_mode *mode, *best = NULL;
+    wl_list_for_each(mode, &wlr_output->modes, link){
+        if (mode->width != width || mode->height != height) continue;
+        if (best == NULL) best = mode;
+        else if (refresh_mhz > 0 && abs(mode->refresh - refresh_mhz) < abs(best->refresh - refresh_mhz)) best = mode;
+        else if (refresh_mhz <= 0 && mode->refresh > best->refresh) best = mode;
+    }
+    return best;
+}
+
+void output_config_apply(struct wlr_output *wlr_output, struct pwc_output_config *config, struct wlr_output_state *state){
+    // Fills in the mode, scale and adaptive sync for an output about to be enabled
+    struct wlr_output_mode *preferred = wlr_output_preferred_mode(wlr_output);
+    if (config != NULL && config->width > 0){
+        struct wlr_output_mode *mode = pick_mode(wlr_output, config->width, config->height, config->refresh_mhz);
+        if (mode != NULL) wlr_output_state_set_mode(state, mode);
+        else if (wl_list_empty(&wlr_output->modes)){
+            wlr_output_state_set_custom_mode(state, config->width, config->height, config->refresh_mhz);
+        }
+        else{
+            wlr_log(WLR_ERROR, "Output %s has no %dx%d mode, using the preferred one", wlr_output->name, config->width, config->height);
+            if (preferred != NULL) wlr_output_state_set_mode(state, preferred);
+        }
+    }
+    else if (preferred != NULL){
+        // Panels often list 60Hz as preferred next to faster modes of the same size
+        wlr_output_state_set_mode(state, pick_mode(wlr_output, preferred->width, preferred->height, 0));
+    }
+    if (config != NULL && config->scale > 0) wlr_output_state_set_scale(state, config->scale);
+    if (config != NULL && config->vrr == PWC_VRR_ON) wlr_output_state_set_adaptive_sync_enabled(state, true);
+}
+
+static void output_manager_apply(struct pwc_server *server, struct wlr_output_configuration_v1 *config, bool test_only){
+    // Applies or tests a configuration from an output management client, all outputs in one backend commit
+    size_t states_len;
+    struct wlr_backend_output_state *states = wlr_output_configuration_v1_build_state(config, &states_len);
+    if (states == NULL){
+        wlr_output_configuration_v1_send_failed(config);
+        wlr_output_configuration_v1_destroy(config);
+        return;
+    }
+    bool ok = test_only ? wlr_backend_test(server->backend, states, states_len) : wlr_backend_commit(server->backend, states, states_len);
+    for (size_t i = 0; i < states_len; i++) wlr_output_state_finish(&states[i].base);
+    free(states);
+
+    if (ok && !test_only){
+        // Positions aren't part of the output state, they live in the layout
+        struct wlr_output_configuration_head_v1 *head;
+        wl_list_for_each(head, &config->heads, link){
+            struct pwc_output *output = head->state.output->data;
+            if (output == NULL) continue;
+            if (head->state.enabled) output_add_to_layout(output, true, head->state.x, head->state.y);
+            else wlr_output_layout_remove(server->output_layout, head->state.output);
+        }
+    }
+    if (ok) wlr_output_configuration_v1_send_succeeded(config);
+    else wlr_output_configuration_v1_send_failed(config);
+    wlr_output_configuration_v1_destroy(config);
+}
+
+static void handle_output_manager_apply(struct wl_listener *listener, void *data){
+    struct pwc_server *server = wl_container_of(listener, server, output_manager_apply);
+    output_manager_apply(server, data, false);
+}
+
+static void handle_output_manager_test(struct wl_listener *listener, void *data){
+    struct pwc_server *server = wl_container_of(listener, server, output_manager_test);
+    output_manager_apply(server, data, true);
+}
+
+static void handle_layout_change(struct wl_listener *listener, void *data){
+    // Whenever outputs are added, removed, moved, resized or rescaled, tell management clients the new state
+    struct pwc_server *server = wl_container_of(listener, server, output_layout_change);
+    struct wlr_output_configuration_v1 *config = wlr_output_configuration_v1_create();
+    if (config == NULL) return;
+    struct pwc_output *output;
+    wl_list_for_each(output, &server->outputs, link){
+        struct wlr_output_configuration_head_v1 *head = wlr_output_configuration_head_v1_create(config, output->wlr_output);
+        if (head == NULL) continue;
+        struct wlr_box box;
+        wlr_output_layout_get_box(server->output_layout, output->wlr_output, &box);
+        // Outputs left out of the layout are reported as disabled
+        head->state.enabled = output->wlr_output->enabled && !wlr_box_empty(&box);
+        head->state.x = box.x;
+        head->state.y = box.y;
+    }
+    wlr_output_manager_v1_set_configuration(server->output_manager, config);
+}
+
+bool output_manager_init(struct pwc_server *server){
+    server->output_manager = wlr_output_manager_v1_create(server->wl_display);
+    if (server->output_manager == NULL){
+        wlr_log(WLR_ERROR, "failed to create wlr_output_manager_v1");
+        return false;
+    }
+    server->output_manager_apply.notify = handle_output_manager_apply;
+    wl_signal_add(&server->output_manager->events.apply, &server->output_manager_apply);
+    server->output_manager_test.notify = handle_output_manager_test;
+    wl_signal_add(&server->output_manager->events.test, &server->output_manager_test);
+    server->output_layout_change.notify = handle_layout_change;
+    wl_signal_add(&server->output_layout->events.change, &server->output_layout_change);
+    // Created after the first frame, when the outputs are already laid out
+    handle_layout_change(&server->output_layout_change, NULL);
+    return true;
+}
+
+void output_manager_finish(struct pwc_server *server){
+    if (server->output_manager == NULL) return;
+    wl_list_remove(&server->output_manager_apply.link);
+    wl_list_remove(&server->output_manager_test.link);
+    wl_list_remove(&server->output_layout_change.link);
+}
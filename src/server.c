@@ -0,0 +1,403 @@
+#include <inttypes.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_cursor_shape_v1.h>
+#include <wlr/types/wlr_data_device.h>
+#include <wlr/types/wlr_ext_foreign_toplevel_list_v1.h>
+#include <wlr/types/wlr_ext_image_capture_source_v1.h>
+#include <wlr/types/wlr_ext_image_copy_capture_v1.h>
+#include <wlr/types/wlr_linux_dmabuf_v1.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_pointer_constraints_v1.h>
+#include <wlr/types/wlr_presentation_time.h>
+#include <wlr/types/wlr_relative_pointer_v1.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_subcompositor.h>
+#include <wlr/types/wlr_tablet_v2.h>
+#include <wlr/types/wlr_tearing_control_v1.h>
+#include <wlr/types/wlr_xcursor_manager.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+#include "server.h"
+
+void server_log_stats(struct pwc_server *server){
+    // Dumps the per-output counters to the log
+    struct pwc_output *output;
+    wl_list_for_each(output, &server->outputs, link){
+        wlr_log(WLR_INFO, "Output %s: %" PRIu64 " frames committed, %" PRIu64 " frames skipped",
+                output->wlr_output->name, output->frames_committed, output->frames_skipped);
+        wlr_log(WLR_INFO, "Output %s: %" PRIu64 " frames torn, %" PRIu64 " async page flips refused",
+                output->wlr_output->name, output->frames_torn, output->tearing_refused);
+        wlr_log(WLR_INFO, "Output %s: direct scanout %s, %" PRIu64 " frames scanned out%s%s",
+                output->wlr_output->name, output->direct_scanout ? "active" : "inactive", output->frames_scanned_out,
+                output->scanout_blocker ? ", " : "", output->scanout_blocker ? output->scanout_blocker : "");
+        wlr_log(WLR_INFO, "Output %s: %dx%d@%.3fHz, scale %.2f, adaptive sync %s",
+                output->wlr_output->name, output->wlr_output->width, output->wlr_output->height, output->wlr_output->refresh / 1000.0,
+                output->wlr_output->scale, output->wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED ? "on" : "off");
+        if (server->render_late){
+            wlr_log(WLR_INFO, "Output %s: %" PRIu64 " render deadlines missed, budget %.2f ms",
+                    output->wlr_output->name, output->deadlines_missed, output_render_budget(output) / 1e6);
+        }
+        uint64_t *intervals = output->present_intervals;
+        wlr_log(WLR_INFO, "Output %s: present intervals in vblanks 1: %" PRIu64 ", 2: %" PRIu64 ", 3: %" PRIu64 ", 4: %" PRIu64
+                ", 5+: %" PRIu64 ", %" PRIu64 " frames discarded", output->wlr_output->name,
+                intervals[0], intervals[1], intervals[2], intervals[3], intervals[4], output->frames_discarded);
+    }
+    if (server->transactions > 0){
+        wlr_log(WLR_INFO, "Layout: %" PRIu64 " transactions, %" PRIu64 " timed out, %.3f ms average wait",
+                server->transactions, server->transactions_timed_out, server->transaction_time_ns / 1e6 / server->transactions);
+    }
+    if (server->foreign_updates > 0){
+        wlr_log(WLR_INFO, "Foreign toplevels: %" PRIu64 " title/app_id changes, %" PRIu64 " update batches sent",
+                server->foreign_updates, server->foreign_updates_sent);
+    }
+    if (server->first_frame_ns != 0){
+        wlr_log(WLR_INFO, "Startup: first frame presented %.3f ms after launch", (server->first_frame_ns - server->startup_start_ns) / 1e6);
+    }
+    if (server->keymap_compiles > 0){
+        wlr_log(WLR_INFO, "Keymaps: %" PRIu64 " compiled in %.3f ms total, %" PRIu64 " keyboards served from the cache",
+                server->keymap_compiles, server->keymap_compile_ns / 1e6, server->keymap_cache_hits);
+    }
+    if (server->xwayland_starts > 0){
+        wlr_log(WLR_INFO, "Xwayland: started %" PRIu64 " times on demand", server->xwayland_starts);
+    }
+    if (server->spawns > 0){
+        wlr_log(WLR_INFO, "Launcher: %" PRIu64 " commands spawned, event loop stalled %.3f ms average, %.3f ms max",
+                server->spawns, server->spawn_time_ns / 1e6 / server->spawns, server->spawn_time_max_ns / 1e6);
+    }
+    if (server->coalesce_motion){
+        wlr_log(WLR_INFO, "Pointer motion: %" PRIu64 " events, %" PRIu64 " coalesced",
+                server->motion_events, server->motion_coalesced);
+    }
+    if (server->cursor_image_changes > 0){
+        wlr_log(WLR_INFO, "Cursor: %" PRIu64 " image changes, %" PRIu64 " sets of the image already shown skipped",
+                server->cursor_image_changes, server->cursor_sets_skipped);
+    }
+    if (server->tablet_events > 0){
+        wlr_log(WLR_INFO, "Tablet: %" PRIu64 " tool events, %" PRIu64 " hit tests",
+                server->tablet_events, server->tablet_hit_tests);
+    }
+    if (server->motion_constrained > 0){
+        wlr_log(WLR_INFO, "Pointer constraints: %" PRIu64 " motion events delivered locked or confined, without a hit test",
+                server->motion_constrained);
+    }
+    if (server->resize_configures > 0){
+        wlr_log(WLR_INFO, "Interactive resize: %" PRIu64 " configures sent, %" PRIu64 " sizes superseded while one was in flight",
+                server->resize_configures, server->resize_superseded);
+    }
+    if (server->surfaces_occluded_max > 0){
+        wlr_log(WLR_INFO, "Occlusion: %" PRIu64 " surfaces hidden and throttled now, %" PRIu64 " at most, %" PRIu64 " throttled frame callbacks",
+                server->surfaces_occluded, server->surfaces_occluded_max, server->occluded_frames_sent);
+    }
+    struct pwc_hit_index *hit_index = &server->hit_index;
+    if (hit_index->hit_tests > 0){
+        wlr_log(WLR_INFO, "Hit-testing: %" PRIu64 " lookups, %.1f%% cached, %.2f us average",
+                hit_index->hit_tests, 100.0 * hit_index->cache_hits / hit_index->hit_tests,
+                hit_index->time_ns / 1e3 / hit_index->hit_tests);
+    }
+    uint64_t log_written, log_dropped;
+    logger_stats(&log_written, &log_dropped);
+    if (log_written > 0 || log_dropped > 0){
+        wlr_log(WLR_INFO, "Logging: %" PRIu64 " messages written, %" PRIu64 " dropped", log_written, log_dropped);
+    }
+}
+
+static int handle_signal_stats(int signal_number, void *data){
+    // SIGUSR1 dumps stats without stopping the compositor
+    struct pwc_server *server = data;
+    server_log_stats(server);
+    return 0;
+}
+
+static int handle_signal_log_level(int signal_number, void *data){
+    // SIGHUP turns debug logging on, and back to the -v level on the next one (info when that was debug already)
+    struct pwc_server *server = data;
+    enum wlr_log_importance verbosity = WLR_DEBUG;
+    if (wlr_log_get_verbosity() == WLR_DEBUG) verbosity = server->log_verbosity == WLR_DEBUG ? WLR_INFO : server->log_verbosity;
+    logger_set_verbosity(verbosity);
+    // Logged at error level so the switch shows up whatever the new level is
+    wlr_log(WLR_ERROR, "Log level switched to %s", verbosity == WLR_DEBUG ? "debug" : verbosity == WLR_INFO ? "info" :
+            verbosity == WLR_ERROR ? "error" : "silent");
+    return 0;
+}
+
+bool server_init(struct pwc_server *server){
+    // Sets up everything the compositor needs, up to but not including the socket and starting the backend.
+    // Options like render_late have to be set on the server before calling this
+
+    if (server->startup_start_ns == 0) startup_begin(server);
+
+    // The wayland display is managed by libwayland. It handles accepting clients from the Unix..
+    // socket, managing Wayland globals and so on.
+    server->wl_display = wl_display_create();
+    // The backend is a wlroots feature which abstracts the underlying input and output hardware.
+    // The autocreate option will choose the most suitable backend based on the current environment.
+    server->backend = wlr_backend_autocreate(wl_display_get_event_loop(server->wl_display), NULL);
+    if (server->backend == NULL){
+        wlr_log(WLR_ERROR, "failed to create wlr_backend");
+        return false;
+    }
+    startup_phase(server, "backend");
+
+    // Autocreates a renderer, either pixman, GLES2 or Vulkan. THe user can also specify a renderer..
+    // using the WLR_RENDERER env var. The renderer is responsible for defining the various pixel formats..
+    // it supports for shared memory, this configures that for clients.
+    server->renderer = wlr_renderer_autocreate(server->backend);
+    if (server->renderer == NULL){
+        wlr_log(WLR_ERROR, "failed to create wlr_renderer");
+        return false;
+    }
+
+    // Shared memory buffers work with any renderer. linux-dmabuf is set up with the scene further down
+    wlr_renderer_init_wl_shm(server->renderer, server->wl_display);
+    startup_phase(server, "renderer");
+
+    // Autocreate an allocator.
+    // The allocator is the bridge between the renderer and the backend. It handles the buffer creation..
+    // allowing wlroots to render onto the screen.
+    server->allocator = wlr_allocator_autocreate(server->backend, server->renderer);
+    if (server->allocator == NULL){
+        wlr_log(WLR_ERROR, "failed to create wlr_allocator");
+        return false;
+    }
+    startup_phase(server, "allocator");
+
+    // This creates some hands-off wlroots interfaces. The compositor is necessary for clients to allocate..
+    // surfaces, the subcompositor allows to assign the role of subsurfaces to surfaces and the data device..
+    // manager handles the clipboard. Each of these wlroots interfaces has room for you to play with their..
+    // behaviour.
+    // Note: Client cannot set the selection directly without compositor approval. See the handling of the..
+    // request_set_selection event below
+    server->compositor = wlr_compositor_create(server->wl_display, 5, server->renderer);
+    wlr_subcompositor_create(server->wl_display);
+    wlr_data_device_manager_create(server->wl_display);
+
+    // Creates an output layout, which is a wlroots utility for working with an arrangment of screens in a physical layout
+    server->output_layout = wlr_output_layout_create(server->wl_display);
+
+    // Configures a listener to be notified when new outputs are available on the backend
+    wl_list_init(&server->outputs);
+    server->new_output.notify = server_new_output;
+    wl_signal_add(&server->backend->events.new_output, &server->new_output);
+    // Filled by -o before server_init() gets called
+    if (server->output_configs.next == NULL) wl_list_init(&server->output_configs);
+    startup_phase(server, "core protocols");
+
+    // Creates a scene graph. wlroots abstraction that handles all rendering and damage tracking. All that needs to be done..
+    // is to add things that should be rendered to the scene graph at the proper positions and then call wlr_scene_output_commit()..
+    // to render a frame if necessary
+    server->scene = wlr_scene_create();
+    server->scene_layout = wlr_scene_attach_output_layout(server->scene, server->output_layout);
+    if (!workspaces_init(server)) return false;
+
+    // linux-dmabuf v4 with feedback. Every surface starts out with the renderer's formats, then the scene sends..
+    // a tranche of what the primary plane takes to buffers that are direct scanout candidates (a lone fullscreen..
+    // window) and the default feedback again once they stop being one. Backends without a DRM device (headless,..
+    // nested) have no planes to describe and keep the default feedback
+    if (wlr_renderer_get_texture_formats(server->renderer, WLR_BUFFER_CAP_DMABUF) != NULL){
+        server->linux_dmabuf = wlr_linux_dmabuf_v1_create_with_renderer(server->wl_display, 4, server->renderer);
+        if (server->linux_dmabuf == NULL){
+            wlr_log(WLR_ERROR, "failed to create linux-dmabuf, clients are limited to shared memory");
+        }
+        else if (wlr_backend_get_drm_fd(server->backend) >= 0){
+            wlr_scene_set_linux_dmabuf_v1(server->scene, server->linux_dmabuf);
+        }
+    }
+    else wlr_log(WLR_INFO, "Renderer can't import dmabufs, clients are limited to shared memory");
+    if (!layout_init(server)) return false;
+    if (!occlusion_init(server)) return false;
+    startup_phase(server, "scene");
+
+    // presentation-time feedback. The scene reports which outputs each surface was shown on, wlroots fills in the..
+    // timestamp, refresh interval and vblank sequence from the output's present events
+    wlr_presentation_create(server->wl_display, server->backend, 2);
+
+    // The foreign toplevel list names windows for screen capture and taskbars. It stays here rather than with the..
+    // deferred capture globals because every window that maps gets a handle in it
+    server->foreign_toplevel_list = wlr_ext_foreign_toplevel_list_v1_create(server->wl_display, 1);
+    server->foreign_update_timer = wl_event_loop_add_timer(wl_display_get_event_loop(server->wl_display), server_flush_foreign_toplevels, server);
+
+    // Set up xdg-shell version 3. Wayland protocall which is used for application windows.
+    // https://drewdevault.com/2018/07/29/Wayland-shells.html
+    wl_list_init(&server->toplevels);
+    hit_index_init(&server->hit_index);
+    server->xdg_shell = wlr_xdg_shell_create(server->wl_display, 3);
+    server->new_xdg_toplevel.notify = server_new_xdg_toplevel;
+    wl_signal_add(&server->xdg_shell->events.new_toplevel, &server->new_xdg_toplevel);
+    server->new_xdg_popup.notify = server_new_xdg_popup;
+    wl_signal_add(&server->xdg_shell->events.new_popup, &server->new_xdg_popup);
+    startup_phase(server, "globals");
+
+    // Creates a cursor, which is a wlroots utility for tracking the cursor image shown on screen
+    server->cursor = wlr_cursor_create();
+    wlr_cursor_attach_output_layout(server->cursor, server->output_layout);
+
+    // Creates an xcursor manager. wlroots utility which loads up xcursor themes to source cursor images from..
+    // and makes sure that cursor images are available at all scale factors on the screen ( necessary for HiDPI support ).
+    // The theme itself is only read once the first frame is up, see server_init_deferred()
+    server->cursor_mgr = wlr_xcursor_manager_create(NULL, 24);
+
+    // wlr_cursor ONLY displays an image on screen. Input device needs to be attached. ALl aggregate events will be generated. In..
+    // these events we can choose how we want to process them, forwarding them to clients and moving the cursor around.
+    // https://drewdevault.com/2018/07/17/Input-handling-in-wlroots.html
+    server->cursor_mode = PWC_CURSOR_PASSTHROUGH;
+    server->cursor_motion.notify = server_cursor_motion;
+    wl_signal_add(&server->cursor->events.motion, &server->cursor_motion);
+    server->cursor_motion_absolute.notify = server_cursor_motion_absolute;
+    wl_signal_add(&server->cursor->events.motion_absolute, &server->cursor_motion_absolute);
+    server->cursor_button.notify = server_cursor_button;
+    wl_signal_add(&server->cursor->events.button, &server->cursor_button);
+    server->cursor_axis.notify = server_cursor_axis;
+    wl_signal_add(&server->cursor->events.axis, &server->cursor_axis);
+    server->cursor_frame.notify = server_cursor_frame;
+    wl_signal_add(&server->cursor->events.frame, &server->cursor_frame);
+    // Tablet tools move the same cursor, see tablet.c
+    server->cursor_tablet_tool_axis.notify = server_tablet_tool_axis;
+    wl_signal_add(&server->cursor->events.tablet_tool_axis, &server->cursor_tablet_tool_axis);
+    server->cursor_tablet_tool_proximity.notify = server_tablet_tool_proximity;
+    wl_signal_add(&server->cursor->events.tablet_tool_proximity, &server->cursor_tablet_tool_proximity);
+    server->cursor_tablet_tool_tip.notify = server_tablet_tool_tip;
+    wl_signal_add(&server->cursor->events.tablet_tool_tip, &server->cursor_tablet_tool_tip);
+    server->cursor_tablet_tool_button.notify = server_tablet_tool_button;
+    wl_signal_add(&server->cursor->events.tablet_tool_button, &server->cursor_tablet_tool_button);
+
+    // Configures a seat, which is a single "seat" at which a user sits and operates the computer. This includes up to one keyboard, pointer..
+    // touch, drawing tablet device. A listener is also rigged to let us know when new input devices are available on the backend
+    wl_list_init(&server->keyboards);
+    if (!keymap_cache_init(server)) return false;
+    server->new_input.notify = server_new_input;
+    wl_signal_add(&server->backend->events.new_input, &server->new_input);
+    server->seat = wlr_seat_create(server->wl_display, "seat0");
+    server->request_cursor.notify = seat_request_cursor;
+    wl_signal_add(&server->seat->events.request_set_cursor, &server->request_cursor);
+    server->pointer_focus_change.notify = seat_pointer_focus_change;
+    wl_signal_add(&server->seat->pointer_state.events.focus_change, &server->pointer_focus_change);
+    server->request_set_selection.notify = seat_request_set_selection;
+    wl_signal_add(&server->seat->events.request_set_selection, &server->request_set_selection);
+    server->relative_pointer_manager = wlr_relative_pointer_manager_v1_create(server->wl_display);
+    // cursor-shape lets clients name a cursor from our theme instead of uploading a cursor surface of their own
+    server->cursor_shape_manager = wlr_cursor_shape_manager_v1_create(server->wl_display, 1);
+    server->request_set_shape.notify = seat_request_set_shape;
+    wl_signal_add(&server->cursor_shape_manager->events.request_set_shape, &server->request_set_shape);
+    // Pointer lock and confinement, honoured while the surface has both pointer and keyboard focus
+    server->pointer_constraints = wlr_pointer_constraints_v1_create(server->wl_display);
+    server->new_pointer_constraint.notify = server_new_pointer_constraint;
+    wl_signal_add(&server->pointer_constraints->events.new_constraint, &server->new_pointer_constraint);
+    server->keyboard_focus_change.notify = seat_keyboard_focus_change;
+    wl_signal_add(&server->seat->keyboard_state.events.focus_change, &server->keyboard_focus_change);
+    // tablet-v2 for drawing tablets and their pads
+    wl_list_init(&server->tablets);
+    wl_list_init(&server->tablet_tools);
+    wl_list_init(&server->tablet_pads);
+    server->tablet_manager = wlr_tablet_v2_create(server->wl_display);
+    startup_phase(server, "cursor and seat");
+
+    // Dump stats to the log whenever we get SIGUSR1
+    server->stats_source = wl_event_loop_add_signal(wl_display_get_event_loop(server->wl_display), SIGUSR1, handle_signal_stats, server);
+    // and switch debug logging on and off on SIGHUP
+    server->log_level_source = wl_event_loop_add_signal(wl_display_get_event_loop(server->wl_display), SIGHUP, handle_signal_log_level, server);
+    if (!launcher_init(server)) return false;
+    if (!trace_init(server)) return false;
+    if (!startup_init(server)) return false;
+
+    return true;
+}
+
+void server_init_deferred(struct pwc_server *server){
+    // Setup that can wait until the first frame is on screen, run once from startup.c. Nothing here is needed to..
+    // show a window, and failing only costs the feature
+
+    // Tearing control lets clients hint that they prefer async page flips over vsync. Only honoured for..
+    // the focused fullscreen surface, see output_allows_tearing()
+    server->tearing_control = wlr_tearing_control_manager_v1_create(server->wl_display, 1);
+
+    // Screen capture through ext-image-copy-capture. Outputs and toplevels (named through the foreign toplevel..
+    // list) can be captured. wlroots tracks damage per capture session, so each frame only carries the regions..
+    // that changed since the client's last one, and dmabuf targets are offered when the renderer supports them.
+    wlr_ext_image_copy_capture_manager_v1_create(server->wl_display, 1);
+    wlr_ext_output_image_capture_source_manager_v1_create(server->wl_display, 1);
+    server->toplevel_capture_manager = wlr_ext_foreign_toplevel_image_capture_source_manager_v1_create(server->wl_display, 1);
+    if (server->toplevel_capture_manager != NULL){
+        server->new_toplevel_capture_request.notify = server_new_toplevel_capture_request;
+        wl_signal_add(&server->toplevel_capture_manager->events.new_request, &server->new_toplevel_capture_request);
+    }
+
+    // wlr-output-management lets clients change modes, scale and positions at runtime
+    output_manager_init(server);
+
+#if HAVE_XWAYLAND
+    // Only reserves the X11 socket. The startup command is launched after this, so it gets DISPLAY
+    xwayland_init(server);
+#endif
+
+    // Reads the cursor theme at the scale of every output and shows the default cursor, instead of stalling on the..
+    // first pointer motion
+    if (server->seat->pointer_state.focused_surface == NULL){
+        cursor_set_xcursor(server, "default");
+    }
+}
+
+void server_finish(struct pwc_server *server){
+    // Destroy all clients then shutdown the server
+    server_log_stats(server);
+    wl_event_source_remove(server->stats_source);
+    wl_event_source_remove(server->log_level_source);
+    if (server->motion_idle != NULL) wl_event_source_remove(server->motion_idle);
+    launcher_finish(server);
+    startup_finish(server);
+    trace_finish(server);
+#if HAVE_XWAYLAND
+    xwayland_finish(server);
+#endif
+    wl_event_source_remove(server->foreign_update_timer);
+    occlusion_finish(server);
+
+    wl_display_destroy_clients(server->wl_display);
+
+    wl_list_remove(&server->new_xdg_toplevel.link);
+    wl_list_remove(&server->new_xdg_popup.link);
+
+    wl_list_remove(&server->cursor_motion.link);
+    wl_list_remove(&server->cursor_motion_absolute.link);
+    wl_list_remove(&server->cursor_button.link);
+    wl_list_remove(&server->cursor_axis.link);
+    wl_list_remove(&server->cursor_frame.link);
+    wl_list_remove(&server->cursor_tablet_tool_axis.link);
+    wl_list_remove(&server->cursor_tablet_tool_proximity.link);
+    wl_list_remove(&server->cursor_tablet_tool_tip.link);
+    wl_list_remove(&server->cursor_tablet_tool_button.link);
+
+    wl_list_remove(&server->new_input.link);
+    wl_list_remove(&server->request_cursor.link);
+    wl_list_remove(&server->pointer_focus_change.link);
+    wl_list_remove(&server->request_set_selection.link);
+    wl_list_remove(&server->request_set_shape.link);
+    wl_list_remove(&server->new_pointer_constraint.link);
+    wl_list_remove(&server->keyboard_focus_change.link);
+
+    wl_list_remove(&server->new_output.link);
+    output_manager_finish(server);
+    output_configs_finish(server);
+    if (server->toplevel_capture_manager != NULL) wl_list_remove(&server->new_toplevel_capture_request.link);
+    hit_index_finish(&server->hit_index);
+    workspaces_finish(server);
+    layout_finish(server);
+
+    wlr_scene_node_destroy(&server->scene->tree.node);
+    wlr_xcursor_manager_destroy(server->cursor_mgr);
+    wlr_cursor_destroy(server->cursor);
+    keymap_cache_finish(server);
+    wlr_allocator_destroy(server->allocator);
+    wlr_renderer_destroy(server->renderer);
+    wlr_backend_destroy(server->backend);
+    wl_display_destroy(server->wl_display);
+}
@@ -0,0 +1,95 @@
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+#include "server.h"
+
+// Startup profiling and deferred initialization. The path from exec to the first frame only sets up what that..
+// frame needs: backend, renderer, allocator, the core protocols, the scene and the seat. Globals no client needs..
+// yet and the cursor theme wait until the first frame has been presented, see server_init_deferred(), and the..
+// startup command is launched after that so it sees every global on its first roundtrip.
+//
+// Each phase is timed with startup_phase(). The profile goes to the log at info level with -p, at debug level..
+// otherwise.
+
+void startup_begin(struct pwc_server *server){
+    // Start of the clock, as early in main() as possible. server_init() calls it when nothing did before
+    server->startup_start_ns = get_time_ns();
+    server->startup_mark_ns = server->startup_start_ns;
+}
+
+void startup_phase(struct pwc_server *server, const char *name){
+    // Closes the phase running since the previous mark. name has to be a string literal
+    int64_t now = get_time_ns();
+    if (server->startup_phase_count < PWC_STARTUP_PHASES){
+        struct pwc_startup_phase *phase = &server->startup_phases[server->startup_phase_count++];
+        phase->name = name;
+        phase->duration_ns = now - server->startup_mark_ns;
+    }
+    server->startup_mark_ns = now;
+}
+
+static void startup_log(struct pwc_server *server){
+    enum wlr_log_importance importance = server->startup_profile ? WLR_INFO : WLR_DEBUG;
+    if (server->first_frame_ns != 0){
+        wlr_log(importance, "Startup: first frame presented %.3f ms after launch", (server->first_frame_ns - server->startup_start_ns) / 1e6);
+    }
+    else wlr_log(importance, "Startup: no frame presented within %d ms, ran deferred setup anyway", PWC_STARTUP_DEFER_MS);
+    for (int i = 0; i < server->startup_phase_count; i++){
+        wlr_log(importance, "Startup:   %-16s %9.3f ms", server->startup_phases[i].name, server->startup_phases[i].duration_ns / 1e6);
+    }
+}
+
+static void startup_complete(struct pwc_server *server){
+    if (server->startup_done) return;
+    server->startup_done = true;
+    wl_event_source_timer_update(server->startup_timer, 0);
+    server_init_deferred(server);
+    startup_phase(server, "deferred setup");
+    if (server->startup_cmd != NULL) launcher_spawn(server, server->startup_cmd);
+    startup_log(server);
+}
+
+static void handle_startup_idle(void *data){
+    // Idle sources go away on their own once dispatched
+    struct pwc_server *server = data;
+    server->startup_idle = NULL;
+    startup_complete(server);
+}
+
+static int handle_startup_timer(void *data){
+    // No output presented anything in time (none connected, or all of them off)
+    startup_complete(data);
+    return 0;
+}
+
+void startup_frame_presented(struct pwc_server *server, int64_t when_ns){
+    // Called for the first present on any output, while first_frame_ns is still 0. Deferred setup runs once the..
+    // event loop is idle rather than from inside the present handler
+    server->first_frame_ns = when_ns;
+    struct pwc_startup_phase *phase = server->startup_phase_count < PWC_STARTUP_PHASES ? &server->startup_phases[server->startup_phase_count++] : NULL;
+    if (phase != NULL){
+        phase->name = "first frame";
+        phase->duration_ns = when_ns - server->startup_mark_ns;
+    }
+    server->startup_mark_ns = get_time_ns();
+    // The fallback timer got there first, only the time is still of interest
+    if (server->startup_done){
+        wlr_log(server->startup_profile ? WLR_INFO : WLR_DEBUG, "Startup: first frame presented %.3f ms after launch",
+                (when_ns - server->startup_start_ns) / 1e6);
+        return;
+    }
+    server->startup_idle = wl_event_loop_add_idle(wl_display_get_event_loop(server->wl_display), handle_startup_idle, server);
+    if (server->startup_idle == NULL) startup_complete(server);
+}
+
+bool startup_init(struct pwc_server *server){
+    server->startup_timer = wl_event_loop_add_timer(wl_display_get_event_loop(server->wl_display), handle_startup_timer, server);
+    if (server->startup_timer == NULL) return false;
+    wl_event_source_timer_update(server->startup_timer, PWC_STARTUP_DEFER_MS);
+    return true;
+}
+
+void startup_finish(struct pwc_server *server){
+    if (server->startup_idle != NULL) wl_event_source_remove(server->startup_idle);
+    server->startup_idle = NULL;
+    wl_event_source_remove(server->startup_timer);
+}
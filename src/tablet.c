@@ -0,0 +1,325 @@
+#include <linux/input-event-codes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_input_device.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_tablet_pad.h>
+#include <wlr/types/wlr_tablet_tool.h>
+#include <wlr/types/wlr_tablet_v2.h>
+#include <wlr/util/log.h>
+#include "server.h"
+
+// Drawing tablets through tablet-v2. Tools move the same cursor as the pointer and go to the surface under them..
+// when its client speaks tablet-v2, anything else gets the tool as an emulated pointer (tip as left button).
+// Pads follow keyboard focus.
+//
+// Tablets report at 200 Hz and more, each report a single axis event carrying every axis that changed. All of them..
+// are sent together and wlroots closes them with one frame, and the hit test only runs when the report moved the..
+// tool. While the tip is down the surface keeps the tool, like a held mouse button, so a stroke never hit-tests..
+// Tip down focuses the window found by the last hit test.
+//
+// The emulated pointer goes through the same button handling as a mouse, so a move or resize started from..
+// client-side decorations follows the tool and ends when the tip comes up.
+
+static void tablet_tool_destroy(struct wl_listener *listener, void *data){
+    // Runs before the tablet-v2 tool goes away, its listener was added after this one
+    struct pwc_tablet_tool *tool = wl_container_of(listener, tool, destroy);
+    tool->wlr_tool->data = NULL;
+    wl_list_remove(&tool->set_cursor.link);
+    wl_list_remove(&tool->destroy.link);
+    wl_list_remove(&tool->link);
+    free(tool);
+}
+
+static void tablet_tool_set_cursor(struct wl_listener *listener, void *data){
+    // Same rule as for the pointer, only the client the tool is over may set the cursor
+    struct pwc_tablet_tool *tool = wl_container_of(listener, tool, set_cursor);
+    struct wlr_tablet_v2_event_cursor *event = data;
+    struct wlr_surface *focused = tool->tool_v2->focused_surface;
+    if (focused == NULL || wl_resource_get_client(focused->resource) != event->seat_client->client) return;
+    struct pwc_server *server = tool->server;
+    server->cursor_xcursor = NULL;
+    server->cursor_image_changes++;
+    wlr_cursor_set_surface(server->cursor, event->surface, event->hotspot_x, event->hotspot_y);
+}
+
+static struct pwc_tablet_tool *tablet_tool_get(struct pwc_server *server, struct wlr_tablet_tool *wlr_tool){
+    // Tools are only known once they come into proximity, the tablet-v2 side is created then
+    if (wlr_tool->data != NULL) return wlr_tool->data;
+    struct pwc_tablet_tool *tool = calloc(1, sizeof(*tool));
+    if (tool == NULL) return NULL;
+    tool->server = server;
+    tool->wlr_tool = wlr_tool;
+    tool->destroy.notify = tablet_tool_destroy;
+    wl_signal_add(&wlr_tool->events.destroy, &tool->destroy);
+    tool->tool_v2 = wlr_tablet_tool_create(server->tablet_manager, server->seat, wlr_tool);
+    if (tool->tool_v2 == NULL){
+        wl_list_remove(&tool->destroy.link);
+        free(tool);
+        return NULL;
+    }
+    tool->set_cursor.notify = tablet_tool_set_cursor;
+    wl_signal_add(&tool->tool_v2->events.set_cursor, &tool->set_cursor);
+    wlr_tool->data = tool;
+    wl_list_insert(&server->tablet_tools, &tool->link);
+    return tool;
+}
+
+void tablet_tools_forget(struct pwc_toplevel *toplevel){
+    // The window is going away, no tool may focus it on its next tip down
+    struct pwc_tablet_tool *tool;
+    wl_list_for_each(tool, &toplevel->server->tablet_tools, link){
+        if (tool->toplevel == toplevel) tool->toplevel = NULL;
+    }
+}
+
+static void tablet_tool_position(struct pwc_tablet_tool *tool, struct pwc_tablet *tablet, uint32_t time_msec){
+    // Sends the cursor position to the surface under the tool, after a hit test unless the tip holds a surface
+    struct pwc_server *server = tool->server;
+    struct wlr_tablet_v2_tablet_tool *tool_v2 = tool->tool_v2;
+    // A move or resize started from the tool, through either protocol, follows it like it follows the pointer
+    if (cursor_grab_motion(server)) return;
+    if (tool_v2->is_down && tool_v2->focused_surface != NULL){
+        wlr_send_tablet_v2_tablet_tool_motion(tool_v2, server->cursor->x - tool->surface_x, server->cursor->y - tool->surface_y);
+        return;
+    }
+
+    double sx = 0, sy = 0;
+    struct wlr_surface *surface = NULL;
+    int64_t trace_start_ns = trace_begin();
+    tool->toplevel = desktop_toplevel_at(server, server->cursor->x, server->cursor->y, &surface, &sx, &sy);
+    trace_end(PWC_TRACE_INPUT, "hit test", trace_start_ns, "tablet");
+    server->tablet_hit_tests++;
+    bool tablet_client = surface != NULL && wlr_surface_accepts_tablet_v2(surface, tablet->tablet_v2);
+
+    if (tool_v2->focused_surface != NULL && (!tablet_client || tool_v2->focused_surface != surface)){
+        wlr_send_tablet_v2_tablet_tool_proximity_out(tool_v2);
+    }
+    if (!tablet_client){
+        // Not a tablet client, the pointer takes over at the tool's position, from the same hit test
+        cursor_pointer_focus(server, time_msec, surface, sx, sy);
+        wlr_seat_pointer_notify_frame(server->seat);
+        return;
+    }
+    tool->surface_x = server->cursor->x - sx;
+    tool->surface_y = server->cursor->y - sy;
+    if (tool_v2->focused_surface != surface) wlr_send_tablet_v2_tablet_tool_proximity_in(tool_v2, tablet->tablet_v2, surface);
+    wlr_send_tablet_v2_tablet_tool_motion(tool_v2, sx, sy);
+}
+
+void server_tablet_tool_axis(struct wl_listener *listener, void *data){
+    // Event is forwarded by the cursor for every report of a tool in proximity
+    struct pwc_server *server = wl_container_of(listener, server, cursor_tablet_tool_axis);
+    struct wlr_tablet_tool_axis_event *event = data;
+    struct pwc_tablet_tool *tool = tablet_tool_get(server, event->tool);
+    struct pwc_tablet *tablet = event->tablet->data;
+    if (tool == NULL || tablet == NULL) return;
+    server->tablet_events++;
+    trace_instant(PWC_TRACE_INPUT, "tablet axis", NULL);
+
+    if (event->updated_axes & (WLR_TABLET_TOOL_AXIS_X | WLR_TABLET_TOOL_AXIS_Y)){
+        // Mice and lenses on a tablet move relative to where they are, pens are mapped onto the whole layout
+        if (event->tool->type == WLR_TABLET_TOOL_TYPE_MOUSE || event->tool->type == WLR_TABLET_TOOL_TYPE_LENS){
+            wlr_cursor_move(server->cursor, &event->tablet->base, event->dx, event->dy);
+        }
+        else{
+            wlr_cursor_warp_absolute(server->cursor, &event->tablet->base, event->updated_axes & WLR_TABLET_TOOL_AXIS_X ? event->x : NAN,
+                    event->updated_axes & WLR_TABLET_TOOL_AXIS_Y ? event->y : NAN);
+        }
+        tablet_tool_position(tool, tablet, event->time_msec);
+    }
+
+    struct wlr_tablet_v2_tablet_tool *tool_v2 = tool->tool_v2;
+    // An emulated pointer has no use for the other axes
+    if (tool_v2->focused_surface == NULL) return;
+    if (event->updated_axes & WLR_TABLET_TOOL_AXIS_PRESSURE) wlr_send_tablet_v2_tablet_tool_pressure(tool_v2, event->pressure);
+    if (event->updated_axes & WLR_TABLET_TOOL_AXIS_DISTANCE) wlr_send_tablet_v2_tablet_tool_distance(tool_v2, event->distance);
+    if (event->updated_axes & (WLR_TABLET_TOOL_AXIS_TILT_X | WLR_TABLET_TOOL_AXIS_TILT_Y)){
+        wlr_send_tablet_v2_tablet_tool_tilt(tool_v2, event->tilt_x, event->tilt_y);
+    }
+    if (event->updated_axes & WLR_TABLET_TOOL_AXIS_ROTATION) wlr_send_tablet_v2_tablet_tool_rotation(tool_v2, event->rotation);
+    if (event->updated_axes & WLR_TABLET_TOOL_AXIS_SLIDER) wlr_send_tablet_v2_tablet_tool_slider(tool_v2, event->slider);
+    if (event->updated_axes & WLR_TABLET_TOOL_AXIS_WHEEL) wlr_send_tablet_v2_tablet_tool_wheel(tool_v2, event->wheel_delta, 0);
+}
+
+void server_tablet_tool_proximity(struct wl_listener *listener, void *data){
+    // Event is forwarded by the cursor when a tool comes close enough to the tablet to be tracked, or leaves
+    struct pwc_server *server = wl_container_of(listener, server, cursor_tablet_tool_proximity);
+    struct wlr_tablet_tool_proximity_event *event = data;
+    struct pwc_tablet_tool *tool = tablet_tool_get(server, event->tool);
+    struct pwc_tablet *tablet = event->tablet->data;
+    if (tool == NULL || tablet == NULL) return;
+    server->tablet_events++;
+    if (event->state == WLR_TABLET_TOOL_PROXIMITY_OUT){
+        if (tool->tool_v2->focused_surface != NULL) wlr_send_tablet_v2_tablet_tool_proximity_out(tool->tool_v2);
+        return;
+    }
+    wlr_cursor_warp_absolute(server->cursor, &event->tablet->base, event->x, event->y);
+    tablet_tool_position(tool, tablet, event->time_msec);
+}
+
+void server_tablet_tool_tip(struct wl_listener *listener, void *data){
+    // Event is forwarded by the cursor when the tool touches the tablet or lifts off it
+    struct pwc_server *server = wl_container_of(listener, server, cursor_tablet_tool_tip);
+    struct wlr_tablet_tool_tip_event *event = data;
+    struct pwc_tablet_tool *tool = tablet_tool_get(server, event->tool);
+    struct pwc_tablet *tablet = event->tablet->data;
+    if (tool == NULL || tablet == NULL) return;
+    server->tablet_events++;
+    trace_instant(PWC_TRACE_INPUT, "tablet tip", NULL);
+    bool down = event->state == WLR_TABLET_TOOL_TIP_DOWN;
+    // The window under the tool is known from the last position report, no need to hit-test again
+    if (down && tool->toplevel != NULL && tool->toplevel->workspace == server->active_workspace) focus_toplevel(tool->toplevel);
+
+    struct wlr_tablet_v2_tablet_tool *tool_v2 = tool->tool_v2;
+    if (tool_v2->focused_surface == NULL){
+        cursor_button(server, event->time_msec, BTN_LEFT, down ? WL_POINTER_BUTTON_STATE_PRESSED : WL_POINTER_BUTTON_STATE_RELEASED);
+        wlr_seat_pointer_notify_frame(server->seat);
+        return;
+    }
+    if (down) wlr_send_tablet_v2_tablet_tool_down(tool_v2);
+    else{
+        wlr_send_tablet_v2_tablet_tool_up(tool_v2);
+        // A move or resize the client started with the tool's serial ends with the stroke
+        reset_cursor_mode(server);
+        // The stroke may have ended over another window
+        tablet_tool_position(tool, tablet, event->time_msec);
+    }
+}
+
+void server_tablet_tool_button(struct wl_listener *listener, void *data){
+    // Event is forwarded by the cursor when a button on the tool itself is pressed or released
+    struct pwc_server *server = wl_container_of(listener, server, cursor_tablet_tool_button);
+    struct wlr_tablet_tool_button_event *event = data;
+    struct pwc_tablet_tool *tool = tablet_tool_get(server, event->tool);
+    if (tool == NULL) return;
+    server->tablet_events++;
+    if (tool->tool_v2->focused_surface != NULL){
+        wlr_send_tablet_v2_tablet_tool_button(tool->tool_v2, event->button, (enum zwp_tablet_pad_v2_button_state)event->state);
+        return;
+    }
+    // Emulated pointer: the stylus buttons act as right and middle click
+    uint32_t button = event->button == BTN_STYLUS ? BTN_RIGHT : event->button == BTN_STYLUS2 ? BTN_MIDDLE : 0;
+    if (button == 0) return;
+    cursor_button(server, event->time_msec, button,
+            event->state == WLR_BUTTON_PRESSED ? WL_POINTER_BUTTON_STATE_PRESSED : WL_POINTER_BUTTON_STATE_RELEASED);
+    wlr_seat_pointer_notify_frame(server->seat);
+}
+
+static void tablet_destroy(struct wl_listener *listener, void *data){
+    struct pwc_tablet *tablet = wl_container_of(listener, tablet, destroy);
+    tablet->wlr_tablet->data = NULL;
+    wl_list_remove(&tablet->destroy.link);
+    wl_list_remove(&tablet->link);
+    free(tablet);
+}
+
+void server_new_tablet(struct pwc_server *server, struct wlr_input_device *device){
+    struct pwc_tablet *tablet = calloc(1, sizeof(*tablet));
+    if (tablet == NULL) return;
+    tablet->server = server;
+    tablet->wlr_tablet = wlr_tablet_from_input_device(device);
+    // Added before the tablet-v2 side exists so it runs first on removal
+    tablet->destroy.notify = tablet_destroy;
+    wl_signal_add(&device->events.destroy, &tablet->destroy);
+    tablet->tablet_v2 = wlr_tablet_create(server->tablet_manager, server->seat, device);
+    if (tablet->tablet_v2 == NULL){
+        wlr_log(WLR_ERROR, "failed to set up tablet %s", device->name);
+        wl_list_remove(&tablet->destroy.link);
+        free(tablet);
+        return;
+    }
+    tablet->wlr_tablet->data = tablet;
+    wl_list_insert(&server->tablets, &tablet->link);
+    wlr_cursor_attach_input_device(server->cursor, device);
+    // A pad that came up before its tablet has had nothing to enter with yet
+    tablet_pads_focus(server, server->seat->keyboard_state.focused_surface);
+}
+
+static void tablet_pad_leave(struct pwc_tablet_pad *pad){
+    if (pad->focused_surface == NULL) return;
+    wlr_send_tablet_v2_tablet_pad_leave(pad->pad_v2, pad->focused_surface);
+    wl_list_remove(&pad->surface_destroy.link);
+    pad->focused_surface = NULL;
+}
+
+static void tablet_pad_surface_destroy(struct wl_listener *listener, void *data){
+    struct pwc_tablet_pad *pad = wl_container_of(listener, pad, surface_destroy);
+    wl_list_remove(&pad->surface_destroy.link);
+    pad->focused_surface = NULL;
+}
+
+void tablet_pads_focus(struct pwc_server *server, struct wlr_surface *surface){
+    // Pads have no position, they go to the surface with keyboard focus
+    if (wl_list_empty(&server->tablets)) return;
+    struct pwc_tablet *tablet = wl_container_of(server->tablets.next, tablet, link);
+    struct pwc_tablet_pad *pad;
+    wl_list_for_each(pad, &server->tablet_pads, link){
+        if (pad->focused_surface == surface) continue;
+        tablet_pad_leave(pad);
+        if (surface == NULL || !wlr_surface_accepts_tablet_v2(surface, tablet->tablet_v2)) continue;
+        wlr_send_tablet_v2_tablet_pad_enter(pad->pad_v2, tablet->tablet_v2, surface);
+        pad->focused_surface = surface;
+        pad->surface_destroy.notify = tablet_pad_surface_destroy;
+        wl_signal_add(&surface->events.destroy, &pad->surface_destroy);
+    }
+}
+
+static void tablet_pad_button(struct wl_listener *listener, void *data){
+    struct pwc_tablet_pad *pad = wl_container_of(listener, pad, button);
+    struct wlr_tablet_pad_button_event *event = data;
+    wlr_send_tablet_v2_tablet_pad_mode(pad->pad_v2, event->group, event->mode, event->time_msec);
+    wlr_send_tablet_v2_tablet_pad_button(pad->pad_v2, event->button, event->time_msec, (enum zwp_tablet_pad_v2_button_state)event->state);
+}
+
+static void tablet_pad_ring(struct wl_listener *listener, void *data){
+    struct pwc_tablet_pad *pad = wl_container_of(listener, pad, ring);
+    struct wlr_tablet_pad_ring_event *event = data;
+    wlr_send_tablet_v2_tablet_pad_ring(pad->pad_v2, event->ring, event->position, event->source == WLR_TABLET_PAD_RING_SOURCE_FINGER,
+            event->time_msec);
+}
+
+static void tablet_pad_strip(struct wl_listener *listener, void *data){
+    struct pwc_tablet_pad *pad = wl_container_of(listener, pad, strip);
+    struct wlr_tablet_pad_strip_event *event = data;
+    wlr_send_tablet_v2_tablet_pad_strip(pad->pad_v2, event->strip, event->position, event->source == WLR_TABLET_PAD_STRIP_SOURCE_FINGER,
+            event->time_msec);
+}
+
+static void tablet_pad_destroy(struct wl_listener *listener, void *data){
+    struct pwc_tablet_pad *pad = wl_container_of(listener, pad, destroy);
+    tablet_pad_leave(pad);
+    wl_list_remove(&pad->button.link);
+    wl_list_remove(&pad->ring.link);
+    wl_list_remove(&pad->strip.link);
+    wl_list_remove(&pad->destroy.link);
+    wl_list_remove(&pad->link);
+    free(pad);
+}
+
+void server_new_tablet_pad(struct pwc_server *server, struct wlr_input_device *device){
+    struct pwc_tablet_pad *pad = calloc(1, sizeof(*pad));
+    if (pad == NULL) return;
+    pad->server = server;
+    // Added before the tablet-v2 side exists so it runs first on removal
+    pad->destroy.notify = tablet_pad_destroy;
+    wl_signal_add(&device->events.destroy, &pad->destroy);
+    pad->pad_v2 = wlr_tablet_pad_create(server->tablet_manager, server->seat, device);
+    if (pad->pad_v2 == NULL){
+        wlr_log(WLR_ERROR, "failed to set up tablet pad %s", device->name);
+        wl_list_remove(&pad->destroy.link);
+        free(pad);
+        return;
+    }
+    struct wlr_tablet_pad *wlr_pad = wlr_tablet_pad_from_input_device(device);
+    pad->button.notify = tablet_pad_button;
+    wl_signal_add(&wlr_pad->events.button, &pad->button);
+    pad->ring.notify = tablet_pad_ring;
+    wl_signal_add(&wlr_pad->events.ring, &pad->ring);
+    pad->strip.notify = tablet_pad_strip;
+    wl_signal_add(&wlr_pad->events.strip, &pad->strip);
+    wl_list_insert(&server->tablet_pads, &pad->link);
+    tablet_pads_focus(server, server->seat->keyboard_state.focused_surface);
+}
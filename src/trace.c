@@ -0,0 +1,178 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+#include "server.h"
+
+// Tracing of the input -> client commit -> composite -> present pipeline, written as Chrome trace-event JSON that..
+// Perfetto and chrome://tracing open directly. -T FILE records from startup until exit, SIGUSR2 starts and stops a..
+// recording at any time. Events are kept in memory while recording and only written out when it stops, so the hot..
+// paths never touch the disk. While nothing is recording, a trace point is a single load of trace_active.
+
+struct trace_event {
+    int64_t start_ns, end_ns;
+    enum pwc_trace_track track;
+    char phase;
+    const char *name; // Always a string literal
+    char detail[PWC_TRACE_DETAIL_MAX];
+};
+
+bool trace_active = false;
+
+static struct {
+    struct trace_event *events;
+    size_t len, capacity;
+    uint64_t dropped;
+    const char *path;
+} trace;
+
+static const char *const track_names[] = {
+    [PWC_TRACE_INPUT] = "Input",
+    [PWC_TRACE_CLIENTS] = "Clients",
+    [PWC_TRACE_OUTPUTS] = "Outputs",
+};
+
+static void detail_copy(char *dst, size_t size, const char *detail){
+    // Long details are cut at the slot size. The cut is moved back to a character boundary, half a UTF-8 sequence..
+    // is invalid JSON and Perfetto rejects the whole file
+    if ((size_t)snprintf(dst, size, "%s", detail) < size) return;
+    size_t len = size - 1;
+    size_t lead = len;
+    while (lead > 0 && ((unsigned char)dst[lead - 1] & 0xC0) == 0x80) lead--;
+    if (lead == 0 || (unsigned char)dst[lead - 1] < 0x80) return;
+    unsigned char c = dst[lead - 1];
+    size_t expected = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+    if (len - (lead - 1) < expected) dst[lead - 1] = '\0';
+}
+
+static void trace_push(enum pwc_trace_track track, char phase, const char *name, int64_t start_ns, int64_t end_ns, const char *detail){
+    if (trace.len == trace.capacity){
+        if (trace.capacity >= PWC_TRACE_MAX_EVENTS){
+            trace.dropped++;
+            return;
+        }
+        size_t capacity = trace.capacity == 0 ? 4096 : trace.capacity * 2;
+        struct trace_event *events = realloc(trace.events, capacity * sizeof(*events));
+        if (events == NULL){
+            trace.dropped++;
+            return;
+        }
+        trace.events = events;
+        trace.capacity = capacity;
+    }
+    struct trace_event *event = &trace.events[trace.len++];
+    event->start_ns = start_ns;
+    event->end_ns = end_ns;
+    event->track = track;
+    event->phase = phase;
+    event->name = name;
+    if (detail != NULL) detail_copy(event->detail, sizeof(event->detail), detail);
+    else event->detail[0] = '\0';
+}
+
+void trace_span(enum pwc_trace_track track, const char *name, int64_t start_ns, const char *detail){
+    if (!trace_active) return;
+    trace_push(track, 'X', name, start_ns, get_time_ns(), detail);
+}
+
+void trace_instant_at(enum pwc_trace_track track, const char *name, int64_t when_ns, const char *detail){
+    if (!trace_active) return;
+    trace_push(track, 'i', name, when_ns, when_ns, detail);
+}
+
+static void write_escaped(FILE *file, const char *text){
+    // Details are client strings (app_id) and need escaping to stay valid JSON
+    for (const char *c = text; *c != '\0'; c++){
+        if (*c == '"' || *c == '\\') fprintf(file, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20) fprintf(file, "\\u%04x", *c);
+        else fputc(*c, file);
+    }
+}
+
+static bool trace_write(const char *path){
+    FILE *file = fopen(path, "w");
+    if (file == NULL){
+        wlr_log_errno(WLR_ERROR, "failed to open trace file %s", path);
+        return false;
+    }
+    int pid = (int)getpid();
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(file, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"pwc\"}}", pid);
+    for (size_t i = 1; i < sizeof(track_names) / sizeof(track_names[0]); i++){
+        fprintf(file, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}", pid, i, track_names[i]);
+    }
+    for (size_t i = 0; i < trace.len; i++){
+        struct trace_event *event = &trace.events[i];
+        // Timestamps are in microseconds, the fraction keeps nanosecond precision
+        fprintf(file, ",\n{\"ph\":\"%c\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f", event->phase, event->name, pid,
+                (int)event->track, event->start_ns / 1e3);
+        if (event->phase == 'X') fprintf(file, ",\"dur\":%.3f", (event->end_ns - event->start_ns) / 1e3);
+        else fprintf(file, ",\"s\":\"t\"");
+        if (event->detail[0] != '\0'){
+            fprintf(file, ",\"args\":{\"detail\":\"");
+            write_escaped(file, event->detail);
+            fprintf(file, "\"}");
+        }
+        fprintf(file, "}");
+    }
+    fprintf(file, "\n]}\n");
+    if (fclose(file) != 0){
+        wlr_log_errno(WLR_ERROR, "failed to write trace file %s", path);
+        return false;
+    }
+    return true;
+}
+
+void trace_start(void){
+    trace.len = 0;
+    trace.dropped = 0;
+    trace_active = true;
+    wlr_log(WLR_INFO, "Tracing started");
+}
+
+void trace_stop(void){
+    // Writes the recording out. This blocks the event loop for a moment, but only once per recording
+    if (!trace_active) return;
+    trace_active = false;
+    if (trace_write(trace.path)){
+        wlr_log(WLR_INFO, "Wrote %zu trace events to %s%s", trace.len, trace.path, trace.dropped > 0 ? " (buffer filled up, the end is missing)" : "");
+    }
+    free(trace.events);
+    trace.events = NULL;
+    trace.len = trace.capacity = 0;
+}
+
+static int handle_signal_trace(int signal_number, void *data){
+    // SIGUSR2 toggles a recording
+    if (trace_active) trace_stop();
+    else trace_start();
+    return 0;
+}
+
+bool trace_init(struct pwc_server *server){
+    // Recordings go to server->trace_path (-T), or $XDG_RUNTIME_DIR/pwc-<pid>.json when only SIGUSR2 is used
+    static char default_path[4096];
+    trace.path = server->trace_path;
+    if (trace.path == NULL){
+        const char *dir = getenv("XDG_RUNTIME_DIR");
+        snprintf(default_path, sizeof(default_path), "%s/pwc-%d.json", dir != NULL ? dir : "/tmp", (int)getpid());
+        trace.path = default_path;
+    }
+    server->trace_source = wl_event_loop_add_signal(wl_display_get_event_loop(server->wl_display), SIGUSR2, handle_signal_trace, server);
+    if (server->trace_source == NULL){
+        wlr_log(WLR_ERROR, "failed to watch SIGUSR2");
+        return false;
+    }
+    if (server->trace_path != NULL) trace_start();
+    return true;
+}
+
+void trace_finish(struct pwc_server *server){
+    // A recording still running at exit is written out
+    trace_stop();
+    if (server->trace_source != NULL) wl_event_source_remove(server->trace_source);
+    server->trace_source = NULL;
+}
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+#include "ext-workspace-v1-protocol.h"
+#include "server.h"
+
+// Workspaces. Each workspace owns a scene subtree and only the active one is enabled, so windows on the others are..
+// skipped by compositing, damage tracking, frame callbacks and hit-testing. Switching is a pair of node enable..
+// toggles, which the next output frame picks up in a single commit.
+//
+// Pagers see them through ext-workspace-v1 as one group spanning every output. Only activation is supported,..
+// the set of workspaces is fixed.
+
+#define PWC_WORKSPACE_MANAGER_VERSION 1
+
+struct pwc_workspace_manager {
+    // One per bound ext_workspace_manager_v1. Handles are NULL once the client destroyed them
+    struct wl_list link;
+    struct pwc_server *server;
+    struct wl_resource *resource;
+    struct wl_resource *group;
+    struct wl_resource *workspaces[PWC_WORKSPACES];
+    // Requests are only applied on commit
+    struct pwc_workspace *pending_activate;
+};
+
+static uint32_t workspace_state(struct pwc_workspace *workspace){
+    return workspace == workspace->server->active_workspace ? EXT_WORKSPACE_HANDLE_V1_STATE_ACTIVE : 0;
+}
+
+static void manager_send_done(struct pwc_server *server){
+    struct pwc_workspace_manager *manager;
+    wl_list_for_each(manager, &server->workspace_managers, link){
+        ext_workspace_manager_v1_send_done(manager->resource);
+    }
+}
+
+static void manager_send_state(struct pwc_server *server, struct pwc_workspace *workspace){
+    struct pwc_workspace_manager *manager;
+    wl_list_for_each(manager, &server->workspace_managers, link){
+        struct wl_resource *resource = manager->workspaces[workspace->index];
+        if (resource != NULL) ext_workspace_handle_v1_send_state(resource, workspace_state(workspace));
+    }
+}
+
+void workspace_activate(struct pwc_workspace *workspace){
+    // Shows the workspace and hides the active one. Focus goes to the most recently focused window on it
+    struct pwc_server *server = workspace->server;
+    struct pwc_workspace *prev = server->active_workspace;
+    if (workspace == prev) return;
+    if (server->grabbed_toplevel != NULL) reset_cursor_mode(server);
+
+    wlr_scene_node_set_enabled(&prev->tree->node, false);
+    wlr_scene_node_set_enabled(&workspace->tree->node, true);
+    server->active_workspace = workspace;
+
+    // Hidden windows drop out of the hit-test index, shown ones come back
+    struct pwc_toplevel *toplevel, *focus = NULL;
+    wl_list_for_each(toplevel, &server->toplevels, link){
+        if (toplevel->workspace == prev) hit_index_update(server, toplevel);
+        else if (toplevel->workspace == workspace){
+            hit_index_update(server, toplevel);
+            if (focus == NULL && !toplevel->unmanaged) focus = toplevel;
+        }
+    }
+    if (focus != NULL) focus_toplevel(focus);
+    else{
+        struct wlr_surface *prev_surface = server->seat->keyboard_state.focused_surface;
+        if (prev_surface != NULL) surface_set_activated(prev_surface, false);
+        wlr_seat_keyboard_notify_clear_focus(server->seat);
+    }
+    cursor_rebase(server);
+
+    manager_send_state(server, prev);
+    manager_send_state(server, workspace);
+    manager_send_done(server);
+    wlr_log(WLR_DEBUG, "Switched to workspace %d", workspace->index + 1);
+}
+
+static void workspace_handle_resource_destroy(struct wl_resource *resource){
+    struct pwc_workspace_manager *manager = wl_resource_get_user_data(resource);
+    if (manager == NULL) return;
+    for (size_t i = 0; i < PWC_WORKSPACES; i++){
+        if (manager->workspaces[i] == resource) manager->workspaces[i] = NULL;
+    }
+}
+
+static void handle_destroy(struct wl_client *client, struct wl_resource *resource){
+    wl_resource_destroy(resource);
+}
+
+static void workspace_handle_activate(struct wl_client *client, struct wl_resource *resource){
+    struct pwc_workspace_manager *manager = wl_resource_get_user_data(resource);
+    if (manager == NULL) return;
+    for (size_t i = 0; i < PWC_WORKSPACES; i++){
+        if (manager->workspaces[i] == resource) manager->pending_activate = &manager->server->workspaces[i];
+    }
+}
+
+static void workspace_handle_unsupported(struct wl_client *client, struct wl_resource *resource){
+    // deactivate and remove. Not advertised in the capabilities, so ignored
+}
+
+static void workspace_handle_assign(struct wl_client *client, struct wl_resource *resource, struct wl_resource *group){
+    // There is only one group, nothing to assign
+}
+
+static const struct ext_workspace_handle_v1_interface workspace_impl = {
+    .destroy = handle_destroy,
+    .activate = workspace_handle_activate,
+    .deactivate = workspace_handle_unsupported,
+    .remove = workspace_handle_unsupported,
+    .assign = workspace_handle_assign,
+};
+
+static void group_handle_resource_destroy(struct wl_resource *resource){
+    struct pwc_workspace_manager *manager = wl_resource_get_user_data(resource);
+    if (manager != NULL) manager->group = NULL;
+}
+
+static void group_handle_create_workspace(struct wl_client *client, struct wl_resource *resource, const char *name){
+    // Not advertised in the capabilities, so ignored
+}
+
+static const struct ext_workspace_group_handle_v1_interface group_impl = {
+    .create_workspace = group_handle_create_workspace,
+    .destroy = handle_destroy,
+};
+
+static void manager_handle_commit(struct wl_client *client, struct wl_resource *resource){
+    struct pwc_workspace_manager *manager = wl_resource_get_user_data(resource);
+    if (manager == NULL || manager->pending_activate == NULL) return;
+    struct pwc_workspace *workspace = manager->pending_activate;
+    manager->pending_activate = NULL;
+    workspace_activate(workspace);
+}
+
+static void manager_destroy(struct pwc_workspace_manager *manager){
+    // Handles stay alive until the client destroys them, but become inert
+    if (manager->group != NULL) wl_resource_set_user_data(manager->group, NULL);
+    for (size_t i = 0; i < PWC_WORKSPACES; i++){
+        if (manager->workspaces[i] != NULL) wl_resource_set_user_data(manager->workspaces[i], NULL);
+    }
+    wl_list_remove(&manager->link);
+    free(manager);
+}
+
+static void manager_handle_stop(struct wl_client *client, struct wl_resource *resource){
+    // The server destroys the manager right after sending finished
+    ext_workspace_manager_v1_send_finished(resource);
+    wl_resource_destroy(resource);
+}
+
+static const struct ext_workspace_manager_v1_interface manager_impl = {
+    .commit = manager_handle_commit,
+    .stop = manager_handle_stop,
+};
+
+static void manager_handle_resource_destroy(struct wl_resource *resource){
+    struct pwc_workspace_manager *manager = wl_resource_get_user_data(resource);
+    if (manager != NULL) manager_destroy(manager);
+}
+
+static void group_send_output_enter(struct pwc_workspace_manager *manager, struct wlr_output *wlr_output){
+    struct wl_client *client = wl_resource_get_client(manager->resource);
+    struct wl_resource *output_resource;
+    wl_resource_for_each(output_resource, &wlr_output->resources){
+        if (wl_resource_get_client(output_resource) == client){
+            ext_workspace_group_handle_v1_send_output_enter(manager->group, output_resource);
+        }
+    }
+}
+
+static void manager_bind(struct wl_client *client, void *data, uint32_t version, uint32_t id){
+    // Advertises the group, its outputs and every workspace in one batch closed by done
+    struct pwc_server *server = data;
+    struct pwc_workspace_manager *manager = calloc(1, sizeof(*manager));
+    if (manager == NULL){
+        wl_client_post_no_memory(client);
+        return;
+    }
+    manager->server = server;
+    manager->resource = wl_resource_create(client, &ext_workspace_manager_v1_interface, version, id);
+    if (manager->resource == NULL){
+        free(manager);
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(manager->resource, &manager_impl, manager, manager_handle_resource_destroy);
+    wl_list_insert(&server->workspace_managers, &manager->link);
+
+    manager->group = wl_resource_create(client, &ext_workspace_group_handle_v1_interface, version, 0);
+    if (manager->group == NULL){
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(manager->group, &group_impl, manager, group_handle_resource_destroy);
+    ext_workspace_manager_v1_send_workspace_group(manager->resource, manager->group);
+    ext_workspace_group_handle_v1_send_capabilities(manager->group, 0);
+    struct pwc_output *output;
+    wl_list_for_each(output, &server->outputs, link) group_send_output_enter(manager, output->wlr_output);
+
+    for (size_t i = 0; i < PWC_WORKSPACES; i++){
+        struct pwc_workspace *workspace = &server->workspaces[i];
+        struct wl_resource *resource = wl_resource_create(client, &ext_workspace_handle_v1_interface, version, 0);
+        if (resource == NULL){
+            wl_client_post_no_memory(client);
+            return;
+        }
+        wl_resource_set_implementation(resource, &workspace_impl, manager, workspace_handle_resource_destroy);
+        manager->workspaces[i] = resource;
+        ext_workspace_manager_v1_send_workspace(manager->resource, resource);
+
+        char name[16];
+        snprintf(name, sizeof(name), "%d", workspace->index + 1);
+        ext_workspace_handle_v1_send_id(resource, name);
+        ext_workspace_handle_v1_send_name(resource, name);
+        struct wl_array coordinates;
+        wl_array_init(&coordinates);
+        uint32_t *coordinate = wl_array_add(&coordinates, sizeof(*coordinate));
+        if (coordinate != NULL){
+            *coordinate = workspace->index;
+            ext_workspace_handle_v1_send_coordinates(resource, &coordinates);
+        }
+        wl_array_release(&coordinates);
+        ext_workspace_handle_v1_send_state(resource, workspace_state(workspace));
+        ext_workspace_handle_v1_send_capabilities(resource, EXT_WORKSPACE_HANDLE_V1_WORKSPACE_CAPABILITIES_ACTIVATE);
+        ext_workspace_group_handle_v1_send_workspace_enter(manager->group, resource);
+    }
+    ext_workspace_manager_v1_send_done(manager->resource);
+}
+
+void workspace_output_bind(struct pwc_server *server, struct wl_resource *output_resource){
+    // A client bound a wl_output, tell its pagers the group covers it
+    struct wl_client *client = wl_resource_get_client(output_resource);
+    struct pwc_workspace_manager *manager;
+    wl_list_for_each(manager, &server->workspace_managers, link){
+        if (manager->group == NULL || wl_resource_get_client(manager->resource) != client) continue;
+        ext_workspace_group_handle_v1_send_output_enter(manager->group, output_resource);
+        ext_workspace_manager_v1_send_done(manager->resource);
+    }
+}
+
+void workspace_output_remove(struct pwc_server *server, struct wlr_output *wlr_output){
+    struct pwc_workspace_manager *manager;
+    wl_list_for_each(manager, &server->workspace_managers, link){
+        if (manager->group == NULL) continue;
+        struct wl_client *client = wl_resource_get_client(manager->resource);
+        struct wl_resource *output_resource;
+        wl_resource_for_each(output_resource, &wlr_output->resources){
+            if (wl_resource_get_client(output_resource) == client){
+                ext_workspace_group_handle_v1_send_output_leave(manager->group, output_resource);
+            }
+        }
+        ext_workspace_manager_v1_send_done(manager->resource);
+    }
+}
+
+bool workspaces_init(struct pwc_server *server){
+    // Every workspace gets a tree for its windows, with a tree for fullscreen ones stacked above it
+    for (size_t i = 0; i < PWC_WORKSPACES; i++){
+        struct pwc_workspace *workspace = &server->workspaces[i];
+        workspace->server = server;
+        workspace->index = i;
+        workspace->tree = wlr_scene_tree_create(&server->scene->tree);
+        workspace->toplevel_tree = wlr_scene_tree_create(workspace->tree);
+        workspace->fullscreen_tree = wlr_scene_tree_create(workspace->tree);
+        wlr_scene_node_set_enabled(&workspace->tree->node, i == 0);
+    }
+    server->active_workspace = &server->workspaces[0];
+
+    wl_list_init(&server->workspace_managers);
+    server->workspace_global = wl_global_create(server->wl_display, &ext_workspace_manager_v1_interface,
+            PWC_WORKSPACE_MANAGER_VERSION, server, manager_bind);
+    if (server->workspace_global == NULL){
+        wlr_log(WLR_ERROR, "failed to create ext_workspace_manager_v1 global");
+        return false;
+    }
+    return true;
+}
+
+void workspaces_finish(struct pwc_server *server){
+    // Clients are gone by now, which took the manager resources and their state with them
+    wl_global_destroy(server->workspace_global);
+}
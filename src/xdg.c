@@ -0,0 +1,618 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_ext_foreign_toplevel_list_v1.h>
+#include <wlr/types/wlr_ext_image_capture_source_v1.h>
+#include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/edges.h>
+#include <wlr/util/log.h>
+#if HAVE_XWAYLAND
+#include <wlr/xwayland.h>
+#endif
+#include "server.h"
+
+// A pwc_toplevel is either an xdg_toplevel or, with Xwayland, an X11 window (xwayland_surface set, xdg_toplevel NULL)..
+// The helpers below hide the difference from stacking, focus, fullscreen and hit-testing, X11 specifics are in xwayland.c
+
+struct wlr_surface *toplevel_surface(struct pwc_toplevel *toplevel){
+#if HAVE_XWAYLAND
+    if (toplevel->xwayland_surface != NULL) return toplevel->xwayland_surface->surface;
+#endif
+    return toplevel->xdg_toplevel->base->surface;
+}
+
+void toplevel_get_geometry(struct pwc_toplevel *toplevel, struct wlr_box *box){
+    // Window geometry relative to the scene tree. X11 windows have no client-side shadows to leave out
+#if HAVE_XWAYLAND
+    if (toplevel->xwayland_surface != NULL){
+        *box = (struct wlr_box){ 0, 0, toplevel->xwayland_surface->width, toplevel->xwayland_surface->height };
+        return;
+    }
+#endif
+    *box = toplevel->xdg_toplevel->base->geometry;
+}
+
+void toplevel_set_position(struct pwc_toplevel *toplevel, int x, int y){
+    // Moves the scene tree. X11 clients position their own popups, so the X server has to hear about it too
+    wlr_scene_node_set_position(&toplevel->scene_tree->node, x, y);
+#if HAVE_XWAYLAND
+    struct wlr_xwayland_surface *xsurface = toplevel->xwayland_surface;
+    if (xsurface != NULL) wlr_xwayland_surface_configure(xsurface, x, y, xsurface->width, xsurface->height);
+#endif
+}
+
+void surface_set_activated(struct wlr_surface *surface, bool activated){
+    // Tells the window owning the surface whether it has focus, so it can repaint accordingly
+    struct wlr_xdg_toplevel *xdg_toplevel = wlr_xdg_toplevel_try_from_wlr_surface(surface);
+    if (xdg_toplevel != NULL){
+        wlr_xdg_toplevel_set_activated(xdg_toplevel, activated);
+        return;
+    }
+#if HAVE_XWAYLAND
+    struct wlr_xwayland_surface *xsurface = wlr_xwayland_surface_try_from_wlr_surface(surface);
+    if (xsurface == NULL || xsurface->override_redirect) return;
+    wlr_xwayland_surface_activate(xsurface, activated);
+    // X11 keeps a stacking order of its own, which decides what gets input when windows overlap on the X side
+    if (activated) wlr_xwayland_surface_restack(xsurface, NULL, XCB_STACK_MODE_ABOVE);
+#endif
+}
+
+void focus_toplevel(struct pwc_toplevel *toplevel){
+  // Only deals with keyboard
+    if (toplevel == NULL) return;
+    struct pwc_server *server = toplevel->server;
+    struct wlr_seat *seat = server -> seat;
+    struct wlr_surface *prev_surface = seat->keyboard_state.focused_surface;
+    struct wlr_surface *surface = toplevel_surface(toplevel);
+    if (prev_surface == surface) return;
+
+    if (prev_surface){
+        // Deactive prevously focused surface. Letclient know it is not longer in focus and repain accordingly
+        surface_set_activated(prev_surface, false);
+    }
+
+    struct wlr_keyboard *keyboard = wlr_seat_get_keyboard(seat);
+    // Move the toplevel to the front
+    wlr_scene_node_raise_to_top(&toplevel->scene_tree->node);
+    hit_index_raise(server, toplevel);
+    wl_list_remove(&toplevel->link);
+    wl_list_insert(&server->toplevels, &toplevel->link);
+    // Activate new surface
+    surface_set_activated(surface, true);
+    // Tell the seat to have the keyboard enter this surface. wlroots keeps track of this and sends key events
+    if (keyboard != NULL){
+        wlr_seat_keyboard_notify_enter(seat, surface, keyboard->keycodes, keyboard->num_keycodes, &keyboard->modifiers);
+    }
+
+}
+
+static struct wlr_output *toplevel_pick_output(struct pwc_toplevel *toplevel, struct wlr_output *requested){
+    // Output to fullscreen on: the one the client asked for, otherwise the one under the cursor
+    if (requested != NULL) return requested;
+    struct pwc_server *server = toplevel->server;
+    return wlr_output_layout_output_at(server->output_layout, server->cursor->x, server->cursor->y);
+}
+
+static void toplevel_send_fullscreen(struct pwc_toplevel *toplevel, bool fullscreen){
+#if HAVE_XWAYLAND
+    if (toplevel->xwayland_surface != NULL){
+        wlr_xwayland_surface_set_fullscreen(toplevel->xwayland_surface, fullscreen);
+        return;
+    }
+#endif
+    wlr_xdg_toplevel_set_fullscreen(toplevel->xdg_toplevel, fullscreen);
+}
+
+static void toplevel_send_size(struct pwc_toplevel *toplevel, const struct wlr_box *box){
+    // Asks for a new size. X11 windows are told their position along with it
+#if HAVE_XWAYLAND
+    if (toplevel->xwayland_surface != NULL){
+        wlr_xwayland_surface_configure(toplevel->xwayland_surface, box->x, box->y, box->width, box->height);
+        return;
+    }
+#endif
+    wlr_xdg_toplevel_set_size(toplevel->xdg_toplevel, box->width, box->height);
+}
+
+static void toplevel_place_fullscreen(struct pwc_toplevel *toplevel, const struct wlr_box *box){
+    // Lines the window geometry up with the output and stretches the backdrop over all of it
+    struct wlr_box geo;
+    toplevel_get_geometry(toplevel, &geo);
+    struct wlr_box *geo_box = &geo;
+    wlr_scene_node_set_position(&toplevel->scene_tree->node, box->x - geo_box->x, box->y - geo_box->y);
+    if (toplevel->fullscreen_backdrop == NULL){
+        static const float black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        toplevel->fullscreen_backdrop = wlr_scene_rect_create(toplevel->scene_tree, box->width, box->height, black);
+        if (toplevel->fullscreen_backdrop == NULL) return;
+        wlr_scene_node_lower_to_bottom(&toplevel->fullscreen_backdrop->node);
+    }
+    else wlr_scene_rect_set_size(toplevel->fullscreen_backdrop, box->width, box->height);
+    wlr_scene_node_set_position(&toplevel->fullscreen_backdrop->node, geo_box->x, geo_box->y);
+}
+
+static void toplevel_drop_backdrop(struct pwc_toplevel *toplevel){
+    if (toplevel->fullscreen_backdrop == NULL) return;
+    wlr_scene_node_destroy(&toplevel->fullscreen_backdrop->node);
+    toplevel->fullscreen_backdrop = NULL;
+}
+
+void toplevel_set_fullscreen(struct pwc_toplevel *toplevel, bool fullscreen, struct wlr_output *wlr_output){
+    // Fullscreen toplevels are sized to their output and moved above everything else, so the scene can scan..
+    // their buffer out directly when nothing else is visible
+    struct pwc_server *server = toplevel->server;
+    if (toplevel == server->grabbed_toplevel) reset_cursor_mode(server);
+    layout_toplevel_remove(toplevel);
+    // Any interactive resize still settling would move the window away from where fullscreen puts it
+    toplevel->resize.in_flight = toplevel->resize.pending = toplevel->resize.reposition = false;
+
+    if (fullscreen) wlr_output = toplevel_pick_output(toplevel, wlr_output);
+    if (fullscreen && wlr_output != NULL){
+        if (toplevel->fullscreen_output == NULL){
+            // Remember the windowed geometry so it can be restored
+            struct wlr_box geo_box;
+            toplevel_get_geometry(toplevel, &geo_box);
+            toplevel->saved_box.x = toplevel->scene_tree->node.x;
+            toplevel->saved_box.y = toplevel->scene_tree->node.y;
+            toplevel->saved_box.width = geo_box.width;
+            toplevel->saved_box.height = geo_box.height;
+        }
+        toplevel->fullscreen_output = wlr_output;
+
+        struct wlr_box box;
+        wlr_output_layout_get_box(server->output_layout, wlr_output, &box);
+        wlr_scene_node_reparent(&toplevel->scene_tree->node, toplevel->workspace->fullscreen_tree);
+        wlr_scene_node_raise_to_top(&toplevel->scene_tree->node);
+        toplevel_place_fullscreen(toplevel, &box);
+        hit_index_raise(server, toplevel);
+        hit_index_update(server, toplevel);
+        toplevel_send_fullscreen(toplevel, true);
+        toplevel_send_size(toplevel, &box);
+        layout_arrange(toplevel->workspace);
+        return;
+    }
+
+    // The client always gets a configure, even if the state didn't change
+    toplevel_send_fullscreen(toplevel, false);
+    if (toplevel->fullscreen_output == NULL) return;
+    toplevel->fullscreen_output = NULL;
+    toplevel_drop_backdrop(toplevel);
+    wlr_scene_node_reparent(&toplevel->scene_tree->node, toplevel->workspace->toplevel_tree);
+    wlr_scene_node_set_position(&toplevel->scene_tree->node, toplevel->saved_box.x, toplevel->saved_box.y);
+    hit_index_raise(server, toplevel);
+    hit_index_update(server, toplevel);
+    toplevel_send_size(toplevel, &toplevel->saved_box);
+    // On a tiled workspace the window gets a tile back instead
+    layout_arrange(toplevel->workspace);
+}
+
+static void toplevel_foreign_state(struct pwc_toplevel *toplevel, struct wlr_ext_foreign_toplevel_handle_v1_state *state){
+    // X11 has no app_id, the WM_CLASS class is the closest thing
+#if HAVE_XWAYLAND
+    if (toplevel->xwayland_surface != NULL){
+        state->title = toplevel->xwayland_surface->title;
+        state->app_id = toplevel->xwayland_surface->class;
+        return;
+    }
+#endif
+    state->title = toplevel->xdg_toplevel->title;
+    state->app_id = toplevel->xdg_toplevel->app_id;
+}
+
+void toplevel_map(struct pwc_toplevel *toplevel){
+    // A window has something to show. Unmanaged ones (X11 menus and tooltips) aren't advertised, focused or tiled
+    wl_list_insert(&toplevel->server->toplevels, &toplevel->link);
+
+    if (!toplevel->unmanaged){
+        // Advertise the window so it can be picked as a capture source
+        struct wlr_ext_foreign_toplevel_handle_v1_state state = {0};
+        toplevel_foreign_state(toplevel, &state);
+        toplevel->foreign_handle = wlr_ext_foreign_toplevel_handle_v1_create(toplevel->server->foreign_toplevel_list, &state);
+        if (toplevel->foreign_handle != NULL) toplevel->foreign_handle->data = toplevel;
+    }
+
+    hit_index_update(toplevel->server, toplevel);
+    if (toplevel->unmanaged) return;
+    // The user may have switched away since the window was created
+    if (toplevel->workspace == toplevel->server->active_workspace) focus_toplevel(toplevel);
+    layout_arrange(toplevel->workspace);
+}
+
+static void xdg_toplevel_map(struct wl_listener *listener, void *data){
+    // Called when the surface is mapped, or ready to display on screen
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, map);
+    // Clients can ask to be fullscreen before mapping, the initial configure already said so
+    if (toplevel->xdg_toplevel->requested.fullscreen){
+        toplevel_set_fullscreen(toplevel, true, toplevel->xdg_toplevel->requested.fullscreen_output);
+    }
+    toplevel_map(toplevel);
+}
+
+void toplevel_unmap(struct pwc_toplevel *toplevel){
+    // Reset cursor mode
+    if (toplevel == toplevel->server->grabbed_toplevel) reset_cursor_mode(toplevel->server);
+    tablet_tools_forget(toplevel);
+    // Drop fullscreen state without configuring, the surface is going away
+    if (toplevel->fullscreen_output != NULL){
+        toplevel->fullscreen_output = NULL;
+        toplevel_drop_backdrop(toplevel);
+        wlr_scene_node_reparent(&toplevel->scene_tree->node, toplevel->workspace->toplevel_tree);
+    }
+    if (toplevel->foreign_handle != NULL){
+        wlr_ext_foreign_toplevel_handle_v1_destroy(toplevel->foreign_handle);
+        toplevel->foreign_handle = NULL;
+        toplevel->foreign_dirty = false;
+    }
+    hit_index_remove(toplevel->server, toplevel);
+    layout_toplevel_remove(toplevel);
+    wl_list_remove(&toplevel->link);
+    // The remaining windows take up the space
+    if (!toplevel->unmanaged) layout_arrange(toplevel->workspace);
+}
+
+static void xdg_toplevel_unmap(struct wl_listener *listener, void *data){
+    // Called when the surface is unmapped, and should no longer be shown
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, unmap);
+    toplevel_unmap(toplevel);
+}
+
+static void xdg_toplevel_commit(struct wl_listener *listener, void *data){
+    // Called when a new surface state is committed
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, commit);
+    trace_instant(PWC_TRACE_CLIENTS, "commit", toplevel->xdg_toplevel->app_id);
+
+    // When an xdg_surface performs an inital commity the compositor must reply with a configuration so that the client..
+    // can map the surface. xdg_toplevel with 0,0 size lets the client pick the dimensions itself.
+    struct wlr_xdg_toplevel *xdg_toplevel = toplevel->xdg_toplevel;
+    if (xdg_toplevel->base->initial_commit){
+        struct wlr_output *wlr_output = xdg_toplevel->requested.fullscreen ?
+            toplevel_pick_output(toplevel, xdg_toplevel->requested.fullscreen_output) : NULL;
+        if (wlr_output != NULL){
+            // Client wants to start fullscreen, configure it at the output size right away
+            struct wlr_box box;
+            wlr_output_layout_get_box(toplevel->server->output_layout, wlr_output, &box);
+            wlr_xdg_toplevel_set_fullscreen(xdg_toplevel, true);
+            wlr_xdg_toplevel_set_size(xdg_toplevel, box.width, box.height);
+        }
+        else wlr_xdg_toplevel_set_size(xdg_toplevel, 0, 0);
+        return;
+    }
+
+    if (toplevel->fullscreen_output != NULL){
+        // Keep the window geometry lined up with the output, the geometry offset can change with any commit
+        struct wlr_box box;
+        wlr_output_layout_get_box(toplevel->server->output_layout, toplevel->fullscreen_output, &box);
+        toplevel_place_fullscreen(toplevel, &box);
+    }
+    else if (toplevel->resize.reposition && (int32_t)(xdg_toplevel->base->current.configure_serial - toplevel->resize.acked_serial) >= 0){
+        // First commit at the size of an interactive resize. The edges that aren't being dragged stay put, using the..
+        // size the client actually picked rather than the one asked for
+        toplevel->resize.reposition = false;
+        struct wlr_box *geo_box = &xdg_toplevel->base->geometry;
+        struct wlr_box *box = &toplevel->resize.acked;
+        int x = (toplevel->resize.edges & WLR_EDGE_LEFT) ? box->x + box->width - geo_box->width : box->x;
+        int y = (toplevel->resize.edges & WLR_EDGE_TOP) ? box->y + box->height - geo_box->height : box->y;
+        wlr_scene_node_set_position(&toplevel->scene_tree->node, x - geo_box->x, y - geo_box->y);
+    }
+    else if (toplevel->workspace->tiling && !toplevel->tile.in_transaction && !wlr_box_empty(&toplevel->tile.box)){
+        // Keep tiled windows on their tile when the geometry offset changes
+        struct wlr_box *geo_box = &xdg_toplevel->base->geometry;
+        wlr_scene_node_set_position(&toplevel->scene_tree->node, toplevel->tile.box.x - geo_box->x, toplevel->tile.box.y - geo_box->y);
+    }
+    layout_toplevel_commit(toplevel);
+    // Buffer size or subsurface layout may have changed
+    if (xdg_toplevel->base->surface->mapped) hit_index_update(toplevel->server, toplevel);
+}
+
+static void xdg_toplevel_destroy(struct wl_listener *listener, void *data){
+    // Called when the xdg_toplevel is destroyed
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, destroy);
+
+    wl_list_remove(&toplevel->map.link);
+    wl_list_remove(&toplevel->unmap.link);
+    wl_list_remove(&toplevel->commit.link);
+    wl_list_remove(&toplevel->destroy.link);
+    wl_list_remove(&toplevel->request_move.link);
+    wl_list_remove(&toplevel->request_resize.link);
+    wl_list_remove(&toplevel->request_maximize.link);
+    wl_list_remove(&toplevel->request_fullscreen.link);
+    wl_list_remove(&toplevel->ack_configure.link);
+    wl_list_remove(&toplevel->set_title.link);
+    wl_list_remove(&toplevel->set_app_id.link);
+
+    // Takes the capture source down with it
+    if (toplevel->image_capture_scene != NULL) wlr_scene_node_destroy(&toplevel->image_capture_scene->tree.node);
+
+    free(toplevel);
+}
+
+static void toplevel_send_resize(struct pwc_toplevel *toplevel){
+    toplevel->resize.sent = toplevel->resize.wanted;
+    toplevel->resize.serial = wlr_xdg_toplevel_set_size(toplevel->xdg_toplevel, toplevel->resize.sent.width, toplevel->resize.sent.height);
+    toplevel->resize.in_flight = true;
+    toplevel->resize.pending = false;
+    toplevel->server->resize_configures++;
+}
+
+void toplevel_resize(struct pwc_toplevel *toplevel, const struct wlr_box *box, uint32_t edges){
+    // Asks the client for a new geometry during an interactive resize. While a configure is in flight only the latest..
+    // geometry is kept, it gets sent as soon as the client acks, so slow clients never build up a backlog
+#if HAVE_XWAYLAND
+    if (toplevel->xwayland_surface != NULL){
+        // X11 has no acks to pace against. The window moves right away and the X server sizes it
+        wlr_xwayland_surface_configure(toplevel->xwayland_surface, box->x, box->y, box->width, box->height);
+        wlr_scene_node_set_position(&toplevel->scene_tree->node, box->x, box->y);
+        toplevel->server->resize_configures++;
+        return;
+    }
+#endif
+    toplevel->resize.wanted = *box;
+    toplevel->resize.edges = edges;
+    if (toplevel->resize.in_flight){
+        if (toplevel->resize.pending) toplevel->server->resize_superseded++;
+        toplevel->resize.pending = true;
+        return;
+    }
+    toplevel_send_resize(toplevel);
+}
+
+static void xdg_toplevel_ack_configure(struct wl_listener *listener, void *data){
+    // Called when the client acks a configure. Clients may skip straight to the newest one, so any serial at or..
+    // after the resize one counts
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, ack_configure);
+    struct wlr_xdg_surface_configure *configure = data;
+    if (!toplevel->resize.in_flight || (int32_t)(configure->serial - toplevel->resize.serial) < 0) return;
+
+    toplevel->resize.in_flight = false;
+    toplevel->resize.acked = toplevel->resize.sent;
+    // The next configure goes out right away and takes over serial, the commit for this one is matched against..
+    // acked_serial
+    toplevel->resize.acked_serial = toplevel->resize.serial;
+    toplevel->resize.reposition = true;
+    if (toplevel->resize.pending) toplevel_send_resize(toplevel);
+}
+
+int server_flush_foreign_toplevels(void *data){
+    // Sends the coalesced title and app_id changes, one done per handle however many updates came in
+    struct pwc_server *server = data;
+    server->foreign_flush_pending = false;
+    struct pwc_toplevel *toplevel;
+    wl_list_for_each(toplevel, &server->toplevels, link){
+        if (!toplevel->foreign_dirty) continue;
+        toplevel->foreign_dirty = false;
+        struct wlr_ext_foreign_toplevel_handle_v1_state state = {0};
+        toplevel_foreign_state(toplevel, &state);
+        wlr_ext_foreign_toplevel_handle_v1_update_state(toplevel->foreign_handle, &state);
+        server->foreign_updates_sent++;
+    }
+    return 0;
+}
+
+void toplevel_queue_foreign_update(struct pwc_toplevel *toplevel){
+    // The first change arms a timer for one frame of the fastest output, later ones until then ride along
+    struct pwc_server *server = toplevel->server;
+    server->foreign_updates++;
+    if (toplevel->foreign_handle == NULL || toplevel->foreign_dirty) return;
+    toplevel->foreign_dirty = true;
+    // Re-arming would push the pending flush back, only arm when nothing else is waiting
+    if (server->foreign_flush_pending) return;
+    server->foreign_flush_pending = true;
+
+    int refresh_mhz = 0;
+    struct pwc_output *output;
+    wl_list_for_each(output, &server->outputs, link){
+        if (output->wlr_output->refresh > refresh_mhz) refresh_mhz = output->wlr_output->refresh;
+    }
+    int delay_ms = refresh_mhz > 0 ? 1000000 / refresh_mhz : 16;
+    if (delay_ms < 1) delay_ms = 1;
+    wl_event_source_timer_update(server->foreign_update_timer, delay_ms);
+}
+
+static void xdg_toplevel_set_title(struct wl_listener *listener, void *data){
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, set_title);
+    toplevel_queue_foreign_update(toplevel);
+}
+
+static void xdg_toplevel_set_app_id(struct wl_listener *listener, void *data){
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, set_app_id);
+    toplevel_queue_foreign_update(toplevel);
+}
+
+void begin_interactive(struct pwc_toplevel *toplevel, enum pwc_cursor_mode mode, uint32_t edges){
+    // This function sets up an interactive move or resize operation where the compositor..
+    // stops propegating pointer events to clients and instead consumes them itself, to move or resize windows
+    struct pwc_server *server = toplevel->server;
+
+    server->grabbed_toplevel = toplevel;
+    server->cursor_mode = mode;
+
+    if (mode == PWC_CURSOR_MOVE){
+        server->grab_x = server->cursor->x - toplevel->scene_tree->node.x;
+        server->grab_y = server->cursor->y - toplevel->scene_tree->node.y;
+    }
+    else{
+        struct wlr_box geo;
+        toplevel_get_geometry(toplevel, &geo);
+        struct wlr_box *geo_box = &geo;
+
+        double border_x = (toplevel->scene_tree->node.x + geo_box->x) + ((edges & WLR_EDGE_RIGHT) ? geo_box->width : 0);
+        double border_y = (toplevel->scene_tree->node.y + geo_box->y) + ((edges & WLR_EDGE_BOTTOM) ? geo_box->height : 0);
+
+        server->grab_x = server->cursor->x - border_x;
+        server->grab_y = server->cursor->y - border_y;
+
+        server->grab_geobox = *geo_box;
+        server->grab_geobox.x += toplevel->scene_tree->node.x;
+        server->grab_geobox.y += toplevel->scene_tree->node.y;
+
+        server->resize_edges = edges;
+    }
+}
+
+static void xdg_toplevel_request_move(struct wl_listener *listener, void *data){
+    // This event is raised when a client would like to begin an interactive move, typically because the user clicked..
+    // on their client-side decorations. A more sophisticated compositor would check the provided serial against a list..
+    // of button press serials sent to this client, to prevent the client from requestin this whenever they want.
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, request_move);
+    if (toplevel->fullscreen_output != NULL || toplevel->workspace->tiling) return;
+    begin_interactive(toplevel, PWC_CURSOR_MOVE, 0);
+}
+
+static void xdg_toplevel_request_resize(struct wl_listener *listener, void *data){
+    // This event is raised when a client would like to begin an interactive resize. ^
+    struct wlr_xdg_toplevel_resize_event *event = data;
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, request_resize);
+    if (toplevel->fullscreen_output != NULL || toplevel->workspace->tiling) return;
+    begin_interactive(toplevel, PWC_CURSOR_RESIZE, event->edges);
+}
+
+static void xdg_toplevel_request_maximize(struct wl_listener *listener, void *data){
+    // This event is raised when a client would like to maximize itself. ^^
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, request_resize);
+    if (toplevel->xdg_toplevel->base->initialized){
+        wlr_xdg_surface_schedule_configure(toplevel->xdg_toplevel->base);
+    }
+}
+
+static void xdg_toplevel_request_fullscreen(struct wl_listener *listener, void *data){
+    // This event is raised when a client would like to fullscreen itself. ^^^
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, request_fullscreen);
+    struct wlr_xdg_toplevel *xdg_toplevel = toplevel->xdg_toplevel;
+    if (!xdg_toplevel->base->initialized) return;
+    if (!xdg_toplevel->base->surface->mapped){
+        // Not mapped yet, just answer with a configure. The map handler takes care of the rest
+        wlr_xdg_toplevel_set_fullscreen(xdg_toplevel, xdg_toplevel->requested.fullscreen);
+        return;
+    }
+    toplevel_set_fullscreen(toplevel, xdg_toplevel->requested.fullscreen, xdg_toplevel->requested.fullscreen_output);
+}
+
+void server_new_toplevel_capture_request(struct wl_listener *listener, void *data){
+    // This event is raised when a client wants to capture a single window, picked from the foreign toplevel list
+    struct pwc_server *server = wl_container_of(listener, server, new_toplevel_capture_request);
+    struct wlr_ext_foreign_toplevel_image_capture_source_manager_v1_request *request = data;
+    struct pwc_toplevel *toplevel = request->toplevel_handle->data;
+
+    if (toplevel->image_capture_source == NULL){
+        // The window gets a scene of its own for capturing. Its surfaces are shared with the main scene so the..
+        // capture session only sees damage when the window itself changes
+        toplevel->image_capture_scene = wlr_scene_create();
+        if (toplevel->xdg_toplevel != NULL) wlr_scene_xdg_surface_create(&toplevel->image_capture_scene->tree, toplevel->xdg_toplevel->base);
+        else wlr_scene_subsurface_tree_create(&toplevel->image_capture_scene->tree, toplevel_surface(toplevel));
+        toplevel->image_capture_source = wlr_ext_image_capture_source_v1_create_with_scene_node(&toplevel->image_capture_scene->tree.node,
+                wl_display_get_event_loop(server->wl_display), server->allocator, server->renderer);
+        if (toplevel->image_capture_source == NULL){
+            wlr_log(WLR_ERROR, "failed to create capture source for toplevel");
+            wlr_scene_node_destroy(&toplevel->image_capture_scene->tree.node);
+            toplevel->image_capture_scene = NULL;
+            return;
+        }
+    }
+    wlr_ext_foreign_toplevel_image_capture_source_manager_v1_request_accept(request, toplevel->image_capture_source);
+}
+
+void server_new_xdg_toplevel(struct wl_listener *listener, void *data){
+    // This event is raised when a client creates a new toplevel ( application window )
+    struct pwc_server *server = wl_container_of(listener, server, new_xdg_toplevel);
+    struct wlr_xdg_toplevel *xdg_toplevel = data;
+
+    // Allocate a pwc_toplevel for this surface
+    struct pwc_toplevel *toplevel = calloc(1, sizeof(*toplevel));
+    toplevel->server = server;
+    toplevel->xdg_toplevel = xdg_toplevel;
+    // New windows open on the active workspace
+    toplevel->workspace = server->active_workspace;
+    toplevel->tile.seq = ++server->tile_counter;
+    toplevel->scene_tree = wlr_scene_xdg_surface_create(toplevel->workspace->toplevel_tree, xdg_toplevel->base);
+    toplevel->scene_tree->node.data = toplevel;
+    xdg_toplevel->base->data = toplevel->scene_tree;
+    toplevel->stack_seq = ++server->hit_index.stack_counter;
+
+    // Listen to various events it can emit
+    toplevel->map.notify = xdg_toplevel_map;
+    wl_signal_add(&xdg_toplevel->base->surface->events.map, &toplevel->map);
+    toplevel->unmap.notify = xdg_toplevel_unmap;
+    wl_signal_add(&xdg_toplevel->base->surface->events.unmap, &toplevel->unmap);
+    toplevel->commit.notify = xdg_toplevel_commit;
+    wl_signal_add(&xdg_toplevel->base->surface->events.commit, &toplevel->commit);
+
+    toplevel->destroy.notify = xdg_toplevel_destroy;
+    wl_signal_add(&xdg_toplevel->base->surface->events.destroy, &toplevel->destroy);
+
+    // cotd
+    toplevel->request_move.notify = xdg_toplevel_request_move;
+    wl_signal_add(&xdg_toplevel->events.request_move, &toplevel->request_move);
+    toplevel->request_resize.notify = xdg_toplevel_request_resize;
+    wl_signal_add(&xdg_toplevel->events.request_resize, &toplevel->request_resize);
+    toplevel->request_maximize.notify = xdg_toplevel_request_maximize;
+    wl_signal_add(&xdg_toplevel->events.request_maximize, &toplevel->request_maximize);
+    toplevel->request_fullscreen.notify = xdg_toplevel_request_fullscreen;
+    wl_signal_add(&xdg_toplevel->events.request_fullscreen, &toplevel->request_fullscreen);
+    toplevel->ack_configure.notify = xdg_toplevel_ack_configure;
+    wl_signal_add(&xdg_toplevel->base->events.ack_configure, &toplevel->ack_configure);
+    toplevel->set_title.notify = xdg_toplevel_set_title;
+    wl_signal_add(&xdg_toplevel->events.set_title, &toplevel->set_title);
+    toplevel->set_app_id.notify = xdg_toplevel_set_app_id;
+    wl_signal_add(&xdg_toplevel->events.set_app_id, &toplevel->set_app_id);
+
+}
+
+static void xdg_popup_commit(struct wl_listener *listener, void *data){
+    // Called when a new surface state is committed
+    struct pwc_popup *popup = wl_container_of(listener, popup, commit);
+    trace_instant(PWC_TRACE_CLIENTS, "popup commit", NULL);
+
+    // When an xdg_surface performs an initial commit, the compositor must reply with..
+    // a configuration so the client can map the surface.
+    // A more sophisticated compositor might change a xdg_popup's geometry to ensure it is
+    // positioned offscreen
+    if (popup->xdg_popup->base->initial_commit){
+        wlr_xdg_surface_schedule_configure(popup->xdg_popup->base);
+    }
+    // Popups extend the area the toplevel can be hit in
+    if (popup->toplevel != NULL && popup->toplevel->xdg_toplevel->base->surface->mapped){
+        hit_index_update(popup->toplevel->server, popup->toplevel);
+    }
+}
+
+static void xdg_popup_destroy(struct wl_listener *listener, void *data){
+    // Called when the xdg_popup is destroyed
+    struct pwc_popup *popup = wl_container_of(listener, popup, destroy);
+    if (popup->toplevel != NULL) hit_index_invalidate(popup->toplevel->server);
+
+    wl_list_remove(&popup->commit.link);
+    wl_list_remove(&popup->destroy.link);
+
+    free(popup);
+}
+
+void server_new_xdg_popup(struct wl_listener *listener, void *data){
+    // This event is raised when a client creates a new popup
+    struct wlr_xdg_popup *xdg_popup = data;
+
+    struct pwc_popup *popup = calloc(1,sizeof(*popup));
+    popup->xdg_popup = xdg_popup;
+
+    // xdg popups must be added to the scene graph so they get rendered..
+    // wlroots scene graph provides this but it must have the proper parent scene provided.
+    // To do this we always set the user data field of xdg_surfaces to the corresponding scene node
+    struct wlr_xdg_surface *parent = wlr_xdg_surface_try_from_wlr_surface(xdg_popup->parent);
+    assert(parent != NULL);
+    struct wlr_scene_tree *parent_tree = parent->data;
+    xdg_popup->base->data = wlr_scene_xdg_surface_create(parent_tree, xdg_popup->base);
+    // The toplevel's tree is the first ancestor carrying user data, same as in desktop_toplevel_at()
+    struct wlr_scene_tree *tree = parent_tree;
+    while (tree != NULL && tree->node.data == NULL) tree = tree->node.parent;
+    popup->toplevel = tree != NULL ? tree->node.data : NULL;
+
+    popup->commit.notify = xdg_popup_commit;
+    wl_signal_add(&xdg_popup->base->surface->events.commit, &popup->commit);
+
+    // The popup role goes away with its parent, listen to that rather than the surface so popup->toplevel never dangles
+    popup->destroy.notify = xdg_popup_destroy;
+    wl_signal_add(&xdg_popup->events.destroy, &popup->destroy);
+}
@@ -0,0 +1,263 @@
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/util/edges.h>
+#include <wlr/util/log.h>
+#include <wlr/xwayland.h>
+#include "server.h"
+
+// X11 clients through Xwayland. The X11 display socket is reserved at startup but the Xwayland server only starts..
+// when the first X11 client connects, and exits again PWC_XWAYLAND_IDLE_S after the last one left, so a session..
+// without X11 clients never runs it.
+//
+// X11 windows are pwc_toplevels like any other, they share stacking, focus, hit-testing and fullscreen. They float..
+// on tiled workspaces. Unmanaged ones (menus, tooltips, drag icons) place themselves and are stacked with the..
+// fullscreen windows so a menu opened from a fullscreen X11 window shows up above it.
+
+static void xwayland_surface_map(struct wl_listener *listener, void *data){
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, map);
+    struct pwc_server *server = toplevel->server;
+    struct wlr_xwayland_surface *xsurface = toplevel->xwayland_surface;
+
+    // Override-redirect can change while unmapped, so it is only looked at here
+    toplevel->unmanaged = xsurface->override_redirect;
+    if (toplevel->unmanaged){
+        // Goes with whichever workspace is shown when it pops up
+        toplevel->workspace = server->active_workspace;
+        wlr_scene_node_reparent(&toplevel->scene_tree->node, toplevel->workspace->fullscreen_tree);
+        wlr_scene_node_raise_to_top(&toplevel->scene_tree->node);
+        hit_index_raise(server, toplevel);
+    }
+    else wlr_scene_node_reparent(&toplevel->scene_tree->node, toplevel->workspace->toplevel_tree);
+    wlr_scene_node_set_position(&toplevel->scene_tree->node, xsurface->x, xsurface->y);
+
+    toplevel_map(toplevel);
+    if (toplevel->unmanaged){
+        if (wlr_xwayland_surface_override_redirect_wants_focus(xsurface)) focus_toplevel(toplevel);
+    }
+    else if (xsurface->fullscreen) toplevel_set_fullscreen(toplevel, true, NULL);
+}
+
+static void xwayland_surface_unmap(struct wl_listener *listener, void *data){
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, unmap);
+    toplevel_unmap(toplevel);
+}
+
+static void xwayland_surface_commit(struct wl_listener *listener, void *data){
+    // X11 windows resize whenever the X server says so, keep the hit-test bounds up to date
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, commit);
+    trace_instant(PWC_TRACE_CLIENTS, "commit", toplevel->xwayland_surface->class);
+    if (toplevel->xwayland_surface->surface->mapped) hit_index_update(toplevel->server, toplevel);
+}
+
+static void xwayland_surface_associate(struct wl_listener *listener, void *data){
+    // The X11 window got its wl_surface. It is shown once that surface maps
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, associate);
+    struct wlr_surface *surface = toplevel->xwayland_surface->surface;
+
+    toplevel->scene_tree = wlr_scene_tree_create(toplevel->workspace->toplevel_tree);
+    toplevel->scene_tree->node.data = toplevel;
+    wlr_scene_subsurface_tree_create(toplevel->scene_tree, surface);
+
+    toplevel->map.notify = xwayland_surface_map;
+    wl_signal_add(&surface->events.map, &toplevel->map);
+    toplevel->unmap.notify = xwayland_surface_unmap;
+    wl_signal_add(&surface->events.unmap, &toplevel->unmap);
+    toplevel->commit.notify = xwayland_surface_commit;
+    wl_signal_add(&surface->events.commit, &toplevel->commit);
+}
+
+static void xwayland_surface_dissociate(struct wl_listener *listener, void *data){
+    // The wl_surface is going away, always after unmap
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, dissociate);
+    wl_list_remove(&toplevel->map.link);
+    wl_list_remove(&toplevel->unmap.link);
+    wl_list_remove(&toplevel->commit.link);
+    wlr_scene_node_destroy(&toplevel->scene_tree->node);
+    toplevel->scene_tree = NULL;
+    toplevel->fullscreen_backdrop = NULL;
+}
+
+static void xwayland_surface_destroy(struct wl_listener *listener, void *data){
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, destroy);
+
+    wl_list_remove(&toplevel->destroy.link);
+    wl_list_remove(&toplevel->associate.link);
+    wl_list_remove(&toplevel->dissociate.link);
+    wl_list_remove(&toplevel->request_configure.link);
+    wl_list_remove(&toplevel->request_activate.link);
+    wl_list_remove(&toplevel->request_move.link);
+    wl_list_remove(&toplevel->request_resize.link);
+    wl_list_remove(&toplevel->request_fullscreen.link);
+    wl_list_remove(&toplevel->set_geometry.link);
+    wl_list_remove(&toplevel->set_title.link);
+    wl_list_remove(&toplevel->set_app_id.link);
+
+    if (toplevel->image_capture_scene != NULL) wlr_scene_node_destroy(&toplevel->image_capture_scene->tree.node);
+    free(toplevel);
+}
+
+static void xwayland_surface_request_configure(struct wl_listener *listener, void *data){
+    // X11 windows pick their own position and size. Granted unless fullscreen, where the output decides
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, request_configure);
+    struct wlr_xwayland_surface_configure_event *event = data;
+    struct wlr_xwayland_surface *xsurface = toplevel->xwayland_surface;
+    if (toplevel->fullscreen_output != NULL){
+        wlr_xwayland_surface_configure(xsurface, xsurface->x, xsurface->y, xsurface->width, xsurface->height);
+        return;
+    }
+    wlr_xwayland_surface_configure(xsurface, event->x, event->y, event->width, event->height);
+    if (xsurface->surface != NULL && xsurface->surface->mapped){
+        wlr_scene_node_set_position(&toplevel->scene_tree->node, event->x, event->y);
+        hit_index_update(toplevel->server, toplevel);
+    }
+}
+
+static void xwayland_surface_set_geometry(struct wl_listener *listener, void *data){
+    // Unmanaged windows move themselves without asking
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, set_geometry);
+    struct wlr_xwayland_surface *xsurface = toplevel->xwayland_surface;
+    if (!toplevel->unmanaged || xsurface->surface == NULL || !xsurface->surface->mapped) return;
+    wlr_scene_node_set_position(&toplevel->scene_tree->node, xsurface->x, xsurface->y);
+    hit_index_update(toplevel->server, toplevel);
+}
+
+static void xwayland_surface_request_activate(struct wl_listener *listener, void *data){
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, request_activate);
+    struct wlr_xwayland_surface *xsurface = toplevel->xwayland_surface;
+    if (xsurface->surface == NULL || !xsurface->surface->mapped) return;
+    if (toplevel->workspace == toplevel->server->active_workspace) focus_toplevel(toplevel);
+}
+
+static void xwayland_surface_request_move(struct wl_listener *listener, void *data){
+    // _NET_WM_MOVERESIZE from client-side decorations
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, request_move);
+    struct wlr_xwayland_surface *xsurface = toplevel->xwayland_surface;
+    if (toplevel->fullscreen_output != NULL || xsurface->surface == NULL || !xsurface->surface->mapped) return;
+    begin_interactive(toplevel, PWC_CURSOR_MOVE, 0);
+}
+
+static void xwayland_surface_request_resize(struct wl_listener *listener, void *data){
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, request_resize);
+    struct wlr_xwayland_resize_event *event = data;
+    struct wlr_xwayland_surface *xsurface = toplevel->xwayland_surface;
+    if (toplevel->fullscreen_output != NULL || xsurface->surface == NULL || !xsurface->surface->mapped) return;
+    begin_interactive(toplevel, PWC_CURSOR_RESIZE, event->edges);
+}
+
+static void xwayland_surface_request_fullscreen(struct wl_listener *listener, void *data){
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, request_fullscreen);
+    struct wlr_xwayland_surface *xsurface = toplevel->xwayland_surface;
+    // Before mapping the state is only recorded, the map handler takes care of it
+    if (xsurface->surface == NULL || !xsurface->surface->mapped){
+        wlr_xwayland_surface_set_fullscreen(xsurface, xsurface->fullscreen);
+        return;
+    }
+    toplevel_set_fullscreen(toplevel, xsurface->fullscreen, NULL);
+}
+
+static void xwayland_surface_set_title(struct wl_listener *listener, void *data){
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, set_title);
+    toplevel_queue_foreign_update(toplevel);
+}
+
+static void xwayland_surface_set_class(struct wl_listener *listener, void *data){
+    struct pwc_toplevel *toplevel = wl_container_of(listener, toplevel, set_app_id);
+    toplevel_queue_foreign_update(toplevel);
+}
+
+static void xwayland_new_surface(struct wl_listener *listener, void *data){
+    // An X11 window was created. It has no wl_surface until associate
+    struct pwc_server *server = wl_container_of(listener, server, xwayland_new_surface);
+    struct wlr_xwayland_surface *xsurface = data;
+
+    struct pwc_toplevel *toplevel = calloc(1, sizeof(*toplevel));
+    if (toplevel == NULL) return;
+    toplevel->server = server;
+    toplevel->xwayland_surface = xsurface;
+    toplevel->workspace = server->active_workspace;
+    toplevel->tile.seq = ++server->tile_counter;
+    toplevel->stack_seq = ++server->hit_index.stack_counter;
+    xsurface->data = toplevel;
+
+    toplevel->destroy.notify = xwayland_surface_destroy;
+    wl_signal_add(&xsurface->events.destroy, &toplevel->destroy);
+    toplevel->associate.notify = xwayland_surface_associate;
+    wl_signal_add(&xsurface->events.associate, &toplevel->associate);
+    toplevel->dissociate.notify = xwayland_surface_dissociate;
+    wl_signal_add(&xsurface->events.dissociate, &toplevel->dissociate);
+    toplevel->request_configure.notify = xwayland_surface_request_configure;
+    wl_signal_add(&xsurface->events.request_configure, &toplevel->request_configure);
+    toplevel->request_activate.notify = xwayland_surface_request_activate;
+    wl_signal_add(&xsurface->events.request_activate, &toplevel->request_activate);
+    toplevel->request_move.notify = xwayland_surface_request_move;
+    wl_signal_add(&xsurface->events.request_move, &toplevel->request_move);
+    toplevel->request_resize.notify = xwayland_surface_request_resize;
+    wl_signal_add(&xsurface->events.request_resize, &toplevel->request_resize);
+    toplevel->request_fullscreen.notify = xwayland_surface_request_fullscreen;
+    wl_signal_add(&xsurface->events.request_fullscreen, &toplevel->request_fullscreen);
+    toplevel->set_geometry.notify = xwayland_surface_set_geometry;
+    wl_signal_add(&xsurface->events.set_geometry, &toplevel->set_geometry);
+    toplevel->set_title.notify = xwayland_surface_set_title;
+    wl_signal_add(&xsurface->events.set_title, &toplevel->set_title);
+    toplevel->set_app_id.notify = xwayland_surface_set_class;
+    wl_signal_add(&xsurface->events.set_class, &toplevel->set_app_id);
+}
+
+static void xwayland_handle_start(struct wl_listener *listener, void *data){
+    // The first X11 client connected, Xwayland is being launched
+    struct pwc_server *server = wl_container_of(listener, server, xwayland_start);
+    server->xwayland_start_ns = get_time_ns();
+    server->xwayland_starts++;
+}
+
+static void xwayland_handle_ready(struct wl_listener *listener, void *data){
+    struct pwc_server *server = wl_container_of(listener, server, xwayland_ready);
+    wlr_xwayland_set_seat(server->xwayland, server->seat);
+    wlr_log(WLR_INFO, "Xwayland ready on DISPLAY=%s after %.3f ms", server->xwayland->display_name,
+            (get_time_ns() - server->xwayland_start_ns) / 1e6);
+}
+
+bool xwayland_init(struct pwc_server *server){
+    // Reserves the X11 display. Failing here only costs X11 support, the compositor carries on without it
+    struct wlr_xwayland_server_options options = {
+        .lazy = true,
+        .enable_wm = true,
+        .terminate_delay = PWC_XWAYLAND_IDLE_S,
+    };
+    server->xwayland_server = wlr_xwayland_server_create(server->wl_display, &options);
+    if (server->xwayland_server == NULL){
+        wlr_log(WLR_ERROR, "failed to set up Xwayland, X11 clients won't run");
+        return false;
+    }
+    server->xwayland = wlr_xwayland_create_with_server(server->wl_display, server->compositor, server->xwayland_server);
+    if (server->xwayland == NULL){
+        wlr_log(WLR_ERROR, "failed to set up Xwayland, X11 clients won't run");
+        wlr_xwayland_server_destroy(server->xwayland_server);
+        server->xwayland_server = NULL;
+        return false;
+    }
+
+    server->xwayland_start.notify = xwayland_handle_start;
+    wl_signal_add(&server->xwayland_server->events.start, &server->xwayland_start);
+    server->xwayland_ready.notify = xwayland_handle_ready;
+    wl_signal_add(&server->xwayland->events.ready, &server->xwayland_ready);
+    server->xwayland_new_surface.notify = xwayland_new_surface;
+    wl_signal_add(&server->xwayland->events.new_surface, &server->xwayland_new_surface);
+
+    setenv("DISPLAY", server->xwayland->display_name, true);
+    wlr_log(WLR_INFO, "Reserved DISPLAY=%s, Xwayland starts with the first X11 client", server->xwayland->display_name);
+    return true;
+}
+
+void xwayland_finish(struct pwc_server *server){
+    if (server->xwayland == NULL) return;
+    wl_list_remove(&server->xwayland_start.link);
+    wl_list_remove(&server->xwayland_ready.link);
+    wl_list_remove(&server->xwayland_new_surface.link);
+    wlr_xwayland_destroy(server->xwayland);
+    wlr_xwayland_server_destroy(server->xwayland_server);
+    server->xwayland = NULL;
+    server->xwayland_server = NULL;
+}